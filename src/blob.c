@@ -0,0 +1,246 @@
+/*
+===============================================================================
+ Name        : blob.c
+ Author      : Upi Tamminen
+ Version     : 1.0
+ Copyright   : Upi Tamminen (2012)
+ Description : colour blob tracking
+===============================================================================
+*/
+
+#include "blob.h"
+#include "pack.h"
+#include "type.h"
+
+/*
+ * A full 64k entry table indexed by the pixel doesn't fit next to the
+ * frame store, so each channel gets its own table of class bits and a pixel
+ * is in the classes whose bits survive and-ing the three together.
+ */
+static uint8_t blob_r[32], blob_g[64], blob_b[32];
+
+struct blob_run {
+    uint16_t x0, x1;
+    uint8_t cls; /* single class bit */
+    uint8_t label;
+};
+
+/* stats are only kept up to date in the root of each merged set */
+struct blob_label {
+    uint32_t area;
+    uint32_t sum_x2; /* sum of 2 * x, runs add (x0 + x1) * length */
+    uint32_t sum_y;
+    uint16_t x0, y0, x1, y1;
+    uint8_t parent;
+    uint8_t cls;
+};
+
+#define BLOB_NONE 0xff
+
+static struct blob_run blob_runs[2][BLOB_MAX_RUNS];
+static struct blob_label blob_labels[BLOB_MAX_LABELS];
+
+uint32_t blob_set_class(uint8_t cls, uint8_t rmin, uint8_t rmax,
+        uint8_t gmin, uint8_t gmax, uint8_t bmin, uint8_t bmax)
+{
+    uint32_t i;
+
+    if (cls >= BLOB_CLASSES || rmax > 31 || gmax > 63 || bmax > 31 ||
+            rmin > rmax || gmin > gmax || bmin > bmax) {
+        return 0;
+    }
+    blob_clear_class(cls);
+    for (i = rmin; i <= rmax; i ++) {
+        blob_r[i] |= 1 << cls;
+    }
+    for (i = gmin; i <= gmax; i ++) {
+        blob_g[i] |= 1 << cls;
+    }
+    for (i = bmin; i <= bmax; i ++) {
+        blob_b[i] |= 1 << cls;
+    }
+    return 1;
+}
+
+void blob_clear_class(uint8_t cls)
+{
+    uint32_t i;
+
+    for (i = 0; i < 64; i ++) {
+        if (i < 32) {
+            blob_r[i] &= ~(1 << cls);
+            blob_b[i] &= ~(1 << cls);
+        }
+        blob_g[i] &= ~(1 << cls);
+    }
+}
+
+static uint8_t blob_root(uint8_t label)
+{
+    while (blob_labels[label].parent != label) {
+        /* halve the path on the way up */
+        blob_labels[label].parent =
+            blob_labels[blob_labels[label].parent].parent;
+        label = blob_labels[label].parent;
+    }
+    return label;
+}
+
+/* fold set b into set a, both roots */
+static void blob_merge(uint8_t a, uint8_t b)
+{
+    struct blob_label *la = &blob_labels[a], *lb = &blob_labels[b];
+
+    la->area += lb->area;
+    la->sum_x2 += lb->sum_x2;
+    la->sum_y += lb->sum_y;
+    if (lb->x0 < la->x0) la->x0 = lb->x0;
+    if (lb->y0 < la->y0) la->y0 = lb->y0;
+    if (lb->x1 > la->x1) la->x1 = lb->x1;
+    if (lb->y1 > la->y1) la->y1 = lb->y1;
+    lb->parent = a;
+}
+
+static void blob_add_run(uint8_t label, const struct blob_run *run,
+        uint16_t y)
+{
+    struct blob_label *l = &blob_labels[label];
+    uint32_t len = run->x1 - run->x0 + 1;
+
+    l->area += len;
+    l->sum_x2 += (run->x0 + run->x1) * len;
+    l->sum_y += y * len;
+    if (run->x0 < l->x0) l->x0 = run->x0;
+    if (run->x1 > l->x1) l->x1 = run->x1;
+    l->y1 = y;
+}
+
+/* same colour runs of one row, pixels in no class are skipped */
+static uint32_t blob_row_runs(const uint8_t *hi, const uint8_t *lo,
+        uint16_t width, struct blob_run *runs)
+{
+    uint32_t x, n = 0;
+    uint8_t bits, cls = 0;
+
+    for (x = 0; x < width; x ++) {
+        bits = blob_r[hi[x] >> 3] &
+            blob_g[((hi[x] & 0x07) << 3) | (lo[x] >> 5)] &
+            blob_b[lo[x] & 0x1f];
+        bits &= -bits;
+        if (bits && bits == cls) {
+            runs[n - 1].x1 = x;
+            continue;
+        }
+        cls = 0;
+        if (bits && n < BLOB_MAX_RUNS) {
+            runs[n].x0 = runs[n].x1 = x;
+            runs[n].cls = cls = bits;
+            runs[n].label = BLOB_NONE;
+            n ++;
+        }
+    }
+    return n;
+}
+
+uint32_t blob_find(const uint8_t *hi, const uint8_t *lo,
+        uint16_t width, uint16_t height, uint32_t min_area,
+        struct blob_result *res, uint32_t max)
+{
+    struct blob_run *prev = blob_runs[0], *cur = blob_runs[1], *t;
+    struct blob_label *l;
+    uint32_t y, i, j, first, nprev = 0, ncur, nlabels = 0, n = 0;
+    uint8_t label, root;
+
+    for (y = 0; y < height; y ++, hi += width, lo += width) {
+        ncur = blob_row_runs(hi, lo, width, cur);
+        first = 0;
+        for (i = 0; i < ncur; i ++) {
+            /* runs are in order, skip those left of this one for good */
+            while (first < nprev && prev[first].x1 + 1 < cur[i].x0) {
+                first ++;
+            }
+            label = BLOB_NONE;
+            for (j = first; j < nprev && prev[j].x0 <= cur[i].x1 + 1; j ++) {
+                if (prev[j].cls != cur[i].cls || prev[j].label == BLOB_NONE) {
+                    continue;
+                }
+                root = blob_root(prev[j].label);
+                if (label == BLOB_NONE) {
+                    label = root;
+                } else if (root != label) {
+                    blob_merge(label, root);
+                }
+            }
+            if (label == BLOB_NONE) {
+                if (nlabels == BLOB_MAX_LABELS) {
+                    continue; /* out of labels, the run is lost */
+                }
+                label = nlabels++;
+                l = &blob_labels[label];
+                l->area = l->sum_x2 = l->sum_y = 0;
+                l->x0 = cur[i].x0;
+                l->x1 = cur[i].x1;
+                l->y0 = y;
+                l->parent = label;
+                l->cls = cur[i].cls;
+            }
+            cur[i].label = label;
+            blob_add_run(label, &cur[i], y);
+        }
+        t = prev;
+        prev = cur;
+        cur = t;
+        nprev = ncur;
+    }
+
+    /* roots are the blobs, insert them largest first */
+    for (i = 0; i < nlabels; i ++) {
+        l = &blob_labels[i];
+        if (l->parent != i || l->area < min_area) {
+            continue;
+        }
+        for (j = n; j > 0 && res[j - 1].area < l->area; j --) {
+            if (j < max) {
+                res[j] = res[j - 1];
+            }
+        }
+        if (j >= max) {
+            continue;
+        }
+        res[j].cls = 0;
+        for (root = l->cls; root > 1; root >>= 1) {
+            res[j].cls ++;
+        }
+        res[j].area = l->area;
+        res[j].cx = (l->sum_x2 + l->area) / (2 * l->area);
+        res[j].cy = (2 * l->sum_y + l->area) / (2 * l->area);
+        res[j].x0 = l->x0;
+        res[j].y0 = l->y0;
+        res[j].x1 = l->x1;
+        res[j].y1 = l->y1;
+        if (n < max) {
+            n ++;
+        }
+    }
+    return n;
+}
+
+uint32_t blob_pack(const struct blob_result *res, uint32_t n, uint8_t *buf)
+{
+    uint8_t *p = buf;
+    uint32_t i;
+
+    for (i = 0; i < n; i ++, res ++) {
+        *p++ = res->cls;
+        p = pack16(p, res->area > 0xffff ? 0xffff : res->area);
+        p = pack16(p, res->cx);
+        p = pack16(p, res->cy);
+        p = pack16(p, res->x0);
+        p = pack16(p, res->y0);
+        p = pack16(p, res->x1);
+        p = pack16(p, res->y1);
+    }
+    return p - buf;
+}
+
+/* vim: set et sw=4: */
@@ -0,0 +1,43 @@
+#ifndef __BLOB_H
+#define __BLOB_H
+
+#include "type.h"
+
+#define BLOB_CLASSES 8    /* colour ranges */
+#define BLOB_MAX_LABELS 64 /* blobs in progress per frame */
+#define BLOB_MAX_RUNS 64  /* same colour runs per row */
+#define BLOB_MAX_RESULTS 16
+#define BLOB_MIN_AREA 4   /* default, smaller ones are noise */
+
+/* class (u8), area (u16), centroid x & y (u16), box x0 y0 x1 y1 (u16) */
+#define BLOB_PACKED_SIZE 15
+
+/* bounding box is inclusive, centroid rounded to the nearest pixel */
+struct blob_result {
+    uint8_t cls;
+    uint32_t area;
+    uint16_t cx, cy;
+    uint16_t x0, y0, x1, y1;
+};
+
+/*
+ * Colour ranges are in native rgb565 units (r & b 0..31, g 0..63). A pixel
+ * belongs to the lowest numbered class whose ranges it's in.
+ */
+uint32_t blob_set_class(uint8_t cls, uint8_t rmin, uint8_t rmax,
+        uint8_t gmin, uint8_t gmax, uint8_t bmin, uint8_t bmax);
+void blob_clear_class(uint8_t cls);
+
+/*
+ * 8-connected blobs of each class in a planar rgb565 frame, found in one
+ * pass over the rows. Returns up to max blobs of at least min_area pixels,
+ * largest first.
+ */
+uint32_t blob_find(const uint8_t *hi, const uint8_t *lo,
+        uint16_t width, uint16_t height, uint32_t min_area,
+        struct blob_result *res, uint32_t max);
+uint32_t blob_pack(const struct blob_result *res, uint32_t n, uint8_t *buf);
+
+#endif
+
+/* vim: set et sw=4: */
@@ -0,0 +1,90 @@
+/*
+===============================================================================
+ Name        : boot.c
+ Author      : Upi Tamminen
+ Version     : 1.0
+ Copyright   : Upi Tamminen (2012)
+ Description : boot time checkpoints
+===============================================================================
+*/
+
+#ifdef __USE_CMSIS
+#include "LPC17xx.h"
+#endif
+
+#include "boot.h"
+#include "timer.h"
+#include "type.h"
+
+const char * const boot_names[BOOT_NUM] = {
+    "data", "bss", "sysinit", "board", "cams", "mainloop", "firstframe"
+};
+
+/* cycle counts, 0 = not reached yet */
+static uint32_t boot_cycles[BOOT_NUM];
+
+/* cycle count where SystemInit() started changing the clocks */
+static uint32_t boot_switch;
+
+/* first thing in ResetISR, before data & bss are set up */
+void boot_start(void)
+{
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CYCCNT = 0;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+}
+
+/* cycles since boot_start() */
+uint32_t boot_now(void)
+{
+    return DWT->CYCCNT;
+}
+
+/* for marks taken before bss was zeroed */
+void boot_mark_at(uint8_t id, uint32_t cycles)
+{
+    if (id < BOOT_NUM && !boot_cycles[id]) {
+        boot_cycles[id] = cycles ? cycles : 1;
+    }
+}
+
+/* right before SystemInit(), the cycles up to here are at BOOT_IRC_HZ */
+void boot_clock_switch(void)
+{
+    boot_switch = boot_now();
+}
+
+void boot_mark(uint8_t id)
+{
+    uint32_t cycles = boot_now();
+
+    /* before SysTick runs timer_ms() is 0 */
+    if (timer_ms() < BOOT_WINDOW_MS) {
+        boot_mark_at(id, cycles);
+    }
+}
+
+/*
+ * Microseconds from reset to a checkpoint, 0 if it wasn't reached.
+ * Cycles up to boot_clock_switch() are at the irc rate and the rest at
+ * cclk. SystemInit() waits for the oscillator and the pll lock on the
+ * divided down irc & oscillator, those cycles are counted at cclk too:
+ * sysinit and later marks leave out most of that wait.
+ */
+uint32_t boot_us(uint8_t id)
+{
+    uint32_t irc = boot_switch, cycles;
+
+    if (id >= BOOT_NUM || !boot_cycles[id]) {
+        return 0;
+    }
+    cycles = boot_cycles[id];
+    /* no switch recorded without CMSIS, it all ran on the irc */
+    if (!irc || cycles <= irc) {
+        return cycles / (BOOT_IRC_HZ / 1000000);
+    }
+    return irc / (BOOT_IRC_HZ / 1000000) +
+        (cycles - irc) / (SystemCoreClock / 1000000);
+}
+
+/* vim: set et sw=4: */
@@ -0,0 +1,36 @@
+#ifndef __BOOT_H
+#define __BOOT_H
+
+#include "type.h"
+
+/*
+ * Boot checkpoints, timed with the DWT cycle counter that ResetISR starts
+ * before anything else. Each is reached once, later marks are ignored.
+ */
+#define BOOT_DATA        0 /* data sections copied */
+#define BOOT_BSS         1 /* bss zeroed */
+#define BOOT_SYSINIT     2 /* pll running, cclk up */
+#define BOOT_BOARD       3 /* uart, timer & i2c, sensors held in reset */
+#define BOOT_CAMS        4 /* sensors configured */
+#define BOOT_MAIN_LOOP   5
+#define BOOT_FIRST_FRAME 6
+#define BOOT_NUM         7
+
+/* up to SystemInit() the core runs on the internal rc oscillator */
+#define BOOT_IRC_HZ 4000000
+
+/* the cycle counter wraps in ~40 s at 100 MHz, later marks are dropped */
+#define BOOT_WINDOW_MS 30000
+
+extern const char * const boot_names[BOOT_NUM];
+
+void boot_start(void);
+uint32_t boot_now(void);
+void boot_mark_at(uint8_t id, uint32_t cycles);
+void boot_clock_switch(void);
+void boot_mark(uint8_t id);
+uint32_t boot_us(uint8_t id);
+
+#endif
+
+/* vim: set et sw=4: */
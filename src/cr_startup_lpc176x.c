@@ -51,6 +51,8 @@ extern "C" {
 #include "system_LPC17xx.h"
 #endif
 
+#include "boot.h"
+
 //*****************************************************************************
 #if defined (__cplusplus)
 extern "C" {
@@ -269,6 +271,10 @@ extern unsigned int _ebss;
 __attribute__ ((section(".after_vectors")))
 void
 ResetISR(void) {
+	unsigned int data_cycles, bss_cycles;
+
+	// Boot checkpoints are timed from here
+	boot_start();
 
 #ifndef USE_OLD_STYLE_DATA_BSS_INIT
     //
@@ -287,6 +293,7 @@ ResetISR(void) {
 		SectionLen = *SectionTableAddr++;
 		data_init(LoadAddr, ExeAddr, SectionLen);
 	}
+	data_cycles = boot_now();
 	// At this point, SectionTableAddr = &__bss_section_table;
 	// Zero fill the bss segment
 	while (SectionTableAddr < &__bss_section_table_end) {
@@ -294,6 +301,7 @@ ResetISR(void) {
 		SectionLen = *SectionTableAddr++;
 		bss_init(ExeAddr, SectionLen);
 	}
+	bss_cycles = boot_now();
 #else
 	// Use Old Style Data and BSS section initialization.
 	// This will only initialize a single RAM bank.
@@ -305,15 +313,22 @@ ResetISR(void) {
 	EndAddr = &_edata;
 	SectionLen = (void*)EndAddr - (void*)ExeAddr;
 	data_init((unsigned int)LoadAddr, (unsigned int)ExeAddr, SectionLen);
+	data_cycles = boot_now();
 	// Zero fill the bss segment
 	ExeAddr = &_bss;
 	EndAddr = &_ebss;
 	SectionLen = (void*)EndAddr - (void*)ExeAddr;
 	bss_init ((unsigned int)ExeAddr, SectionLen);
+	bss_cycles = boot_now();
 #endif
+	// The marks can only be stored now that bss is zeroed
+	boot_mark_at(BOOT_DATA, data_cycles);
+	boot_mark_at(BOOT_BSS, bss_cycles);
 
 #ifdef __USE_CMSIS
+	boot_clock_switch();
 	SystemInit();
+	boot_mark(BOOT_SYSINIT);
 #endif
 
 #if defined (__cplusplus)
@@ -0,0 +1,107 @@
+/*
+===============================================================================
+ Name        : edge.c
+ Author      : Upi Tamminen
+ Version     : 1.0
+ Copyright   : Upi Tamminen (2012)
+ Description : bit packed sobel edge maps
+===============================================================================
+*/
+
+#include "edge.h"
+#include "pixel.h"
+#include "swar.h"
+#include "type.h"
+
+static uint8_t edge_window[3][EDGE_MAX_WIDTH];
+static uint8_t edge_bits[EDGE_ROW_BYTES(EDGE_MAX_WIDTH)];
+
+static void edge_luma_row(const uint8_t *plane1, const uint8_t *plane2,
+        uint8_t format, uint16_t width, uint8_t *out)
+{
+    uint32_t x;
+
+    if (format == FMT_RGB565) {
+        swar_luma(plane1, plane2, width, out);
+    } else {
+        /* yuv has y in the first plane, luma frames have nothing else */
+        for (x = 0; x < width; x ++) {
+            out[x] = plane1[x];
+        }
+    }
+}
+
+static inline int32_t edge_abs(int32_t v)
+{
+    return v < 0 ? -v : v;
+}
+
+uint32_t edge_size(uint8_t format, uint16_t width, uint16_t height)
+{
+    if (width > EDGE_MAX_WIDTH || width < 3 || height < 3 ||
+            (format != FMT_RGB565 && format != FMT_YUV422 &&
+             format != FMT_LUMA)) {
+        return 0;
+    }
+    return EDGE_ROW_BYTES(width) * height;
+}
+
+uint32_t edge_sobel(const uint8_t *plane1, const uint8_t *plane2,
+        uint8_t format, uint16_t width, uint16_t height, uint16_t threshold,
+        void (*emit)(const uint8_t *row, uint16_t bytes))
+{
+    uint8_t *above, *row, *below, *t;
+    uint32_t x, y, bytes = EDGE_ROW_BYTES(width);
+    int32_t gx, gy;
+
+    if (!edge_size(format, width, height)) {
+        return 0;
+    }
+
+    /* only rgb565 has anything needed in the second plane */
+    if (format != FMT_RGB565) {
+        plane2 = plane1;
+    }
+
+    above = edge_window[0];
+    row = edge_window[1];
+    below = edge_window[2];
+    edge_luma_row(plane1, plane2, format, width, row);
+    edge_luma_row(plane1 + width, plane2 + width, format, width, below);
+
+    for (x = 0; x < bytes; x ++) {
+        edge_bits[x] = 0;
+    }
+    emit(edge_bits, bytes);
+
+    for (y = 1; y < height - 1u; y ++) {
+        t = above;
+        above = row;
+        row = below;
+        below = t;
+        edge_luma_row(plane1 + (y + 1) * width, plane2 + (y + 1) * width,
+                format, width, below);
+
+        for (x = 0; x < bytes; x ++) {
+            edge_bits[x] = 0;
+        }
+        for (x = 1; x < width - 1u; x ++) {
+            gx = (above[x + 1] + 2 * row[x + 1] + below[x + 1]) -
+                (above[x - 1] + 2 * row[x - 1] + below[x - 1]);
+            gy = (below[x - 1] + 2 * below[x] + below[x + 1]) -
+                (above[x - 1] + 2 * above[x] + above[x + 1]);
+            if (edge_abs(gx) + edge_abs(gy) >= threshold) {
+                edge_bits[x >> 3] |= 0x80 >> (x & 7);
+            }
+        }
+        emit(edge_bits, bytes);
+    }
+
+    for (x = 0; x < bytes; x ++) {
+        edge_bits[x] = 0;
+    }
+    emit(edge_bits, bytes);
+    return bytes * height;
+}
+
+/* vim: set et sw=4: */
@@ -0,0 +1,27 @@
+#ifndef __EDGE_H
+#define __EDGE_H
+
+#include "type.h"
+
+#define EDGE_MAX_WIDTH 320
+#define EDGE_THRESHOLD 64 /* default, on |gx| + |gy| of 8 bit luma */
+
+/* bytes in the packed map, rows are padded to a whole byte */
+#define EDGE_ROW_BYTES(w) (((w) + 7) / 8)
+
+/* size of the map for a frame, 0 if it can't be made */
+uint32_t edge_size(uint8_t format, uint16_t width, uint16_t height);
+
+/*
+ * Sobel gradient magnitude thresholded to one bit per pixel, msb first.
+ * Luma is taken from the frame one row at a time into a three row window,
+ * so no second frame buffer is needed. Each packed row is handed to emit()
+ * as soon as it's done. The outermost pixels are never edges.
+ */
+uint32_t edge_sobel(const uint8_t *plane1, const uint8_t *plane2,
+        uint8_t format, uint16_t width, uint16_t height, uint16_t threshold,
+        void (*emit)(const uint8_t *row, uint16_t bytes));
+
+#endif
+
+/* vim: set et sw=4: */
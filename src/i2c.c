@@ -14,12 +14,15 @@
  *   2011.02.08	 ver 1.200   J. Harwood - ported to LPC17xx
  *   2011.03.07  ver 1.210   Larry Viesse - Corrected Buffer Sizes to accommodate writing 32 data bytes (a full page)
  *   2012.03.05  ver 1.999   Upi Tamminen - adopted for my own projects
+ *   2012.06.02  ver 2.000   Upi Tamminen - I2C2 support for a second camera
  *
 *****************************************************************************/
 #include <stdio.h>
 #include "LPC17xx.h"			/* LPC17xx Peripheral Registers */
 #include "type.h"
 #include "i2c.h"
+#include "log.h"
+#include "perf.h"
 
 volatile uint32_t I2CMasterState = I2CSTATE_IDLE;
 volatile uint32_t I2CSlaveState = I2CSTATE_IDLE;
@@ -32,22 +35,25 @@ volatile uint32_t I2CWriteLength;
 volatile uint32_t RdIndex = 0;
 volatile uint32_t WrIndex = 0;
 
+/* bus of the transaction in progress, only one runs at a time */
+static LPC_I2C_TypeDef *I2CActive = LPC_I2C1;
+
 
 /*****************************************************************************
-** Function name:		I2C_IRQHandler
+** Function name:		I2C_Handler
 **
 ** Descriptions:		I2C interrupt handler, deal with master mode only.
 **
-** parameters:			None
+** parameters:			I2C peripheral that raised the interrupt
 ** Returned value:		None
 ** 
 *****************************************************************************/
-void I2C1_IRQHandler(void)
+static void I2C_Handler(LPC_I2C_TypeDef *i2c)
 {
 	uint8_t StatValue;
 
 	/* this handler deals with master read and master write only */
-	StatValue = LPC_I2C1->I2STAT;
+	StatValue = i2c->I2STAT;
 	switch ( StatValue )
 	{
 	case 0x08:
@@ -58,9 +64,9 @@ void I2C1_IRQHandler(void)
 		 * (we always start with a write after START+SLA)
 		 */
 		WrIndex = 0;
-		LPC_I2C1->I2DAT = I2CMasterBuffer[WrIndex++];
-		//LPC_I2C1->I2CONSET = I2CONSET_AA;
-		LPC_I2C1->I2CONCLR = (I2CONCLR_SIC | I2CONCLR_STAC);
+		i2c->I2DAT = I2CMasterBuffer[WrIndex++];
+		//i2c->I2CONSET = I2CONSET_AA;
+		i2c->I2CONCLR = (I2CONCLR_SIC | I2CONCLR_STAC);
 		I2CMasterState = I2CSTATE_PENDING;
 		break;
 	
@@ -72,9 +78,9 @@ void I2C1_IRQHandler(void)
 		 */
 		RdIndex = 0;
 		/* Send SLA with R bit set, */
-		LPC_I2C1->I2DAT = I2CMasterBuffer[WrIndex++];
-		//LPC_I2C1->I2CONSET = I2CONSET_AA;
-		LPC_I2C1->I2CONCLR = (I2CONCLR_SIC | I2CONCLR_STAC);
+		i2c->I2DAT = I2CMasterBuffer[WrIndex++];
+		//i2c->I2CONSET = I2CONSET_AA;
+		i2c->I2CONCLR = (I2CONCLR_SIC | I2CONCLR_STAC);
 	break;
 	
 	case 0x18:
@@ -82,9 +88,9 @@ void I2C1_IRQHandler(void)
 		 * SLA+W has been transmitted; ACK has been received.
 		 * We now start writing bytes.
 		 */
-		LPC_I2C1->I2DAT = I2CMasterBuffer[WrIndex++];
-		//LPC_I2C1->I2CONSET = I2CONSET_AA;
-		LPC_I2C1->I2CONCLR = I2CONCLR_SIC;
+		i2c->I2DAT = I2CMasterBuffer[WrIndex++];
+		//i2c->I2CONSET = I2CONSET_AA;
+		i2c->I2CONCLR = I2CONCLR_SIC;
 		break;
 
 	case 0x20:
@@ -93,9 +99,10 @@ void I2C1_IRQHandler(void)
 		 * Send a stop condition to terminate the transaction
 		 * and signal I2CEngine the transaction is aborted.
 		 */
-		LPC_I2C1->I2CONSET = I2CONSET_STO;
-		LPC_I2C1->I2CONCLR = I2CONCLR_SIC;
+		i2c->I2CONSET = I2CONSET_STO;
+		i2c->I2CONCLR = I2CONCLR_SIC;
 		I2CMasterState = I2CSTATE_SLA_NACK;
+		perf.i2c_nack++;
 		break;
 
 	case 0x28:
@@ -107,7 +114,7 @@ void I2C1_IRQHandler(void)
 		if ( WrIndex < I2CWriteLength )
 		{
 			/* Keep writing as long as bytes avail */
-			LPC_I2C1->I2DAT = I2CMasterBuffer[WrIndex++];
+			i2c->I2DAT = I2CMasterBuffer[WrIndex++];
 		}
 		else
 		{
@@ -115,15 +122,15 @@ void I2C1_IRQHandler(void)
 			{
 				/* Send a Repeated START to initialize a read transaction */
 				/* (handled in state 0x10)                                */
-				LPC_I2C1->I2CONSET = I2CONSET_STA;	/* Set Repeated-start flag */
+				i2c->I2CONSET = I2CONSET_STA;	/* Set Repeated-start flag */
 			}
 			else
 			{
 				I2CMasterState = I2CSTATE_ACK;
-				LPC_I2C1->I2CONSET = I2CONSET_STO;      /* Set Stop flag */
+				i2c->I2CONSET = I2CONSET_STO;      /* Set Stop flag */
 			}
 		}
-		LPC_I2C1->I2CONCLR = I2CONCLR_SIC;
+		i2c->I2CONCLR = I2CONCLR_SIC;
 		break;
 
 	case 0x30:
@@ -132,9 +139,10 @@ void I2C1_IRQHandler(void)
 		 * Send a STOP condition to terminate the transaction and inform the
 		 * I2CEngine that the transaction failed.
 		 */
-		LPC_I2C1->I2CONSET = I2CONSET_STO;
-		LPC_I2C1->I2CONCLR = I2CONCLR_SIC;
+		i2c->I2CONSET = I2CONSET_STO;
+		i2c->I2CONCLR = I2CONCLR_SIC;
 		I2CMasterState = I2CSTATE_NACK;
+		perf.i2c_nack++;
 		break;
 
 	case 0x38:
@@ -146,7 +154,8 @@ void I2C1_IRQHandler(void)
 		 * (this is automatically done by the I2C hardware)
 		 */
 		I2CMasterState = I2CSTATE_ARB_LOSS;
-		LPC_I2C1->I2CONCLR = I2CONCLR_SIC;
+		perf.i2c_arb_loss++;
+		i2c->I2CONCLR = I2CONCLR_SIC;
 		break;
 
 	case 0x40:
@@ -159,14 +168,14 @@ void I2C1_IRQHandler(void)
 		if ( I2CReadLength == 1 )
 		{
 			/* last (and only) byte: send a NACK after data is received */
-			LPC_I2C1->I2CONCLR = I2CONCLR_AAC;
+			i2c->I2CONCLR = I2CONCLR_AAC;
 		}
 		else
 		{
 			/* more bytes to follow: send an ACK after data is received */
-			LPC_I2C1->I2CONSET = I2CONSET_AA;
+			i2c->I2CONSET = I2CONSET_AA;
 		}
-		LPC_I2C1->I2CONCLR = I2CONCLR_SIC;
+		i2c->I2CONCLR = I2CONCLR_SIC;
 		break;
 
 	case 0x48:
@@ -175,9 +184,10 @@ void I2C1_IRQHandler(void)
 		 * Send a stop condition to terminate the transaction
 		 * and signal I2CEngine the transaction is aborted.
 		 */
-		LPC_I2C1->I2CONSET = I2CONSET_STO;
-		LPC_I2C1->I2CONCLR = I2CONCLR_SIC;
+		i2c->I2CONSET = I2CONSET_STO;
+		i2c->I2CONCLR = I2CONCLR_SIC;
 		I2CMasterState = I2CSTATE_SLA_NACK;
+		perf.i2c_nack++;
 		break;
 
 	case 0x50:
@@ -186,18 +196,18 @@ void I2C1_IRQHandler(void)
 		 * Read the byte and check for more bytes to read.
 		 * Send a NOT ACK after the last byte is received
 		 */
-		I2CSlaveBuffer[RdIndex++] = LPC_I2C1->I2DAT;
+		I2CSlaveBuffer[RdIndex++] = i2c->I2DAT;
 		if ( RdIndex < (I2CReadLength-1) )
 		{
 			/* lmore bytes to follow: send an ACK after data is received */
-			LPC_I2C1->I2CONSET = I2CONSET_AA;
+			i2c->I2CONSET = I2CONSET_AA;
 		}
 		else
 		{
 			/* last byte: send a NACK after data is received */
-			LPC_I2C1->I2CONCLR = I2CONCLR_AAC;
+			i2c->I2CONCLR = I2CONCLR_AAC;
 		}
-		LPC_I2C1->I2CONCLR = I2CONCLR_SIC;
+		i2c->I2CONCLR = I2CONCLR_SIC;
 		break;
 	
 	case 0x58:
@@ -207,20 +217,30 @@ void I2C1_IRQHandler(void)
 		 * Generate a STOP condition and flag the I2CEngine that the
 		 * transaction is finished.
 		 */
-		I2CSlaveBuffer[RdIndex++] = LPC_I2C1->I2DAT;
+		I2CSlaveBuffer[RdIndex++] = i2c->I2DAT;
 		I2CMasterState = I2CSTATE_ACK;
-		LPC_I2C1->I2CONSET = I2CONSET_STO;	/* Set Stop flag */
-		LPC_I2C1->I2CONCLR = I2CONCLR_SIC;	/* Clear SI flag */
+		i2c->I2CONSET = I2CONSET_STO;	/* Set Stop flag */
+		i2c->I2CONCLR = I2CONCLR_SIC;	/* Clear SI flag */
 		break;
 
 	
 	default:
-		LPC_I2C1->I2CONCLR = I2CONCLR_SIC;
+		i2c->I2CONCLR = I2CONCLR_SIC;
 	break;
   }
   return;
 }
 
+void I2C1_IRQHandler(void)
+{
+	I2C_Handler(LPC_I2C1);
+}
+
+void I2C2_IRQHandler(void)
+{
+	I2C_Handler(LPC_I2C2);
+}
+
 /*****************************************************************************
 ** Function name:	I2CStart
 **
@@ -237,7 +257,7 @@ static uint32_t I2CStart( void )
 	uint32_t timeout = 0;
 
 	/*--- Issue a start condition ---*/
-	LPC_I2C1->I2CONSET = I2CONSET_STA;	/* Set Start flag */
+	I2CActive->I2CONSET = I2CONSET_STA;	/* Set Start flag */
     
 	while((I2CMasterState != I2CSTATE_PENDING) && (timeout < MAX_TIMEOUT))
 	{
@@ -260,11 +280,11 @@ static uint32_t I2CStop( void )
 {
 	uint32_t timeout = 0;
 
-	LPC_I2C1->I2CONSET = I2CONSET_STO;      /* Set Stop flag */
-	LPC_I2C1->I2CONCLR = I2CONCLR_SIC;  /* Clear SI flag */
+	I2CActive->I2CONSET = I2CONSET_STO;      /* Set Stop flag */
+	I2CActive->I2CONCLR = I2CONCLR_SIC;  /* Clear SI flag */
 
 	/*--- Wait for STOP detected ---*/
-	while((LPC_I2C1->I2CONSET & I2CONSET_STO) && (timeout < MAX_TIMEOUT))
+	while((I2CActive->I2CONSET & I2CONSET_STO) && (timeout < MAX_TIMEOUT))
 	{
 		timeout++;
 	}
@@ -283,48 +303,97 @@ static uint32_t I2CStop( void )
 *****************************************************************************/
 uint32_t I2CInit( uint32_t I2cMode ) 
 {
-        /* 0.19 SDA1 */
-	LPC_PINCON->PINSEL1 |= (0x3 << 6);
-        /* 0.20 SCL1 */
-	LPC_PINCON->PINSEL1 |= (0x3 << 8);
+	if ( I2cMode == I2CSLAVE )
+	{
+		LPC_I2C1->I2ADR0 = PCF8594_ADDR;
+	}
+
+	return I2CInitBus( I2CBUS1 );
+}
+
+/*****************************************************************************
+** Function name:	I2CInitBus
+**
+** Descriptions:	Initialize an I2C controller as master
+**					I2C1 is on P0.19 (SDA) & P0.20 (SCL)
+**					I2C2 is on P0.10 (SDA) & P0.11 (SCL)
+**
+** parameters:		I2CBUS1 or I2CBUS2
+** Returned value:	true or false, return false for an unknown bus
+** 
+*****************************************************************************/
+uint32_t I2CInitBus( uint32_t bus )
+{
+	LPC_I2C_TypeDef *i2c;
+
+	if ( bus == I2CBUS1 )
+	{
+		i2c = LPC_I2C1;
+
+	        /* 0.19 SDA1 */
+		LPC_PINCON->PINSEL1 |= (0x3 << 6);
+	        /* 0.20 SCL1 */
+		LPC_PINCON->PINSEL1 |= (0x3 << 8);
+
+	        /* 0.19 turn off pullup/pulldown */
+		LPC_PINCON->PINMODE1 &= ~(0x1 << 6);
+		LPC_PINCON->PINMODE1 |= (0x1 << 7);
+
+	        /* 0.20 turn off pullup/pulldown */
+		LPC_PINCON->PINMODE1 &= ~(0x1 << 8);
+		LPC_PINCON->PINMODE1 |= (0x1 << 9);
+
+	        /* 0.19 & 0.20 open drain */
+		LPC_PINCON->PINMODE_OD0 |= (0x3 << 19);
+
+		LPC_SC->PCLKSEL1 |= (0x3 << 6);  // cclk/8
+	}
+	else if ( bus == I2CBUS2 )
+	{
+		i2c = LPC_I2C2;
 
-        /* 0.19 turn off pullup/pulldown */
-	LPC_PINCON->PINMODE1 &= ~(0x1 << 6);
-	LPC_PINCON->PINMODE1 |= (0x1 << 7);
+		LPC_SC->PCONP |= (1 << 26);  // power up I2C2
 
-        /* 0.20 turn off pullup/pulldown */
-	LPC_PINCON->PINMODE1 &= ~(0x1 << 8);
-	LPC_PINCON->PINMODE1 |= (0x1 << 9);
+	        /* 0.10 SDA2, 0.11 SCL2 */
+		LPC_PINCON->PINSEL0 &= ~(0xf << 20);
+		LPC_PINCON->PINSEL0 |= (0xa << 20);
 
-        /* 0.19 & 0.20 open drain */
-	LPC_PINCON->PINMODE_OD0 |= (0x3 << 19);
+	        /* 0.10 & 0.11 turn off pullup/pulldown */
+		LPC_PINCON->PINMODE0 &= ~(0xf << 20);
+		LPC_PINCON->PINMODE0 |= (0xa << 20);
 
-	LPC_SC->PCLKSEL1 |= (0x3 << 6);  // cclk/8
+	        /* 0.10 & 0.11 open drain */
+		LPC_PINCON->PINMODE_OD0 |= (0x3 << 10);
+
+		LPC_SC->PCLKSEL1 |= (0x3 << 20);  // cclk/8
+	}
+	else
+	{
+		return( 0 );
+	}
 
 	/*--- Clear flags ---*/
-	LPC_I2C1->I2CONCLR = I2CONCLR_AAC | I2CONCLR_SIC | I2CONCLR_STAC | I2CONCLR_I2ENC;
+	i2c->I2CONCLR = I2CONCLR_AAC | I2CONCLR_SIC | I2CONCLR_STAC | I2CONCLR_I2ENC;
 
 	/*--- Reset registers ---*/
 #if FAST_MODE_PLUS
-	LPC_I2C1->I2SCLL   = I2SCLL_HS_SCLL;
-	LPC_I2C1->I2SCLH   = I2SCLH_HS_SCLH;
+	i2c->I2SCLL   = I2SCLL_HS_SCLL;
+	i2c->I2SCLH   = I2SCLH_HS_SCLH;
 #else
-	//LPC_I2C1->I2SCLL   = 16;  // i2c freq = (100,000,000/8)/ (32) = 390.63khz
-	//LPC_I2C1->I2SCLH   = 16;
-
-	LPC_I2C1->I2SCLL   = 900;
-	LPC_I2C1->I2SCLH   = 900;
+	//i2c->I2SCLL   = 16;  // i2c freq = (100,000,000/8)/ (32) = 390.63khz
+	//i2c->I2SCLH   = 16;
+
+	// i2c freq = (100,000,000/8)/ (125) = 100khz, the sensor is fine
+	// with 400khz but this leaves margin for long wires. Was 900/900
+	// (~7khz), which made the register writes most of the boot time.
+	i2c->I2SCLL   = 63;
+	i2c->I2SCLH   = 62;
 #endif
 
-	if ( I2cMode == I2CSLAVE )
-	{
-		LPC_I2C1->I2ADR0 = PCF8594_ADDR;
-	}
-
 	/* Enable the I2C Interrupt */
-	NVIC_EnableIRQ(I2C1_IRQn);
+	NVIC_EnableIRQ( bus == I2CBUS1 ? I2C1_IRQn : I2C2_IRQn );
 
-	LPC_I2C1->I2CONSET = I2CONSET_I2EN;
+	i2c->I2CONSET = I2CONSET_I2EN;
 	return( 1 );
 }
 
@@ -344,6 +413,23 @@ uint32_t I2CInit( uint32_t I2cMode )
 *****************************************************************************/
 uint32_t I2CEngine( void ) 
 {
+  return I2CEngineBus( I2CBUS1 );
+}
+
+/*****************************************************************************
+** Function name:	I2CEngineBus
+**
+** Descriptions:	Same as I2CEngine, on the given bus
+**
+** parameters:		I2CBUS1 or I2CBUS2
+** Returned value:	Any of the I2CSTATE_... values. See i2c.h
+** 
+*****************************************************************************/
+uint32_t I2CEngineBus( uint32_t bus )
+{
+  uint32_t timeout = 0;
+
+  I2CActive = ( bus == I2CBUS2 ) ? LPC_I2C2 : LPC_I2C1;
   I2CMasterState = I2CSTATE_IDLE;
   RdIndex = 0;
   WrIndex = 0;
@@ -353,25 +439,29 @@ uint32_t I2CEngine( void )
 	return ( 0 );
   }
 
-  /* wait until the state is a terminal state */
-  while (I2CMasterState < 0x100);
+  /* wait until the state is a terminal state, a bus held low by a
+     stuck device gives up instead */
+  while ((I2CMasterState < 0x100) && (timeout < MAX_TIMEOUT))
+  {
+	timeout++;
+  }
+  if ( timeout >= MAX_TIMEOUT )
+  {
+	I2CStop();
+	I2CMasterState = I2CSTATE_TIMEOUT;
+  }
 
   return ( I2CMasterState );
 }
 
+/* first bytes of both buffers, to the log */
 void i2c_showbuffers(void)
 {
-    uint32_t i;
-
-    printf("Slave: ");
-    for (i = 0; i < Slave_Buffer_BUFSIZE; i++) {
-        printf("%d ", I2CSlaveBuffer[i]);
-    }
-    printf(".\nMaster: ");
-    for (i = 0; i < Master_Buffer_BUFSIZE; i++) {
-        printf("%d ", I2CMasterBuffer[i]);
-    }
-    printf(".\n");
+    LOG3(LOG_I2C_BUFFERS, I2CMasterState,
+            I2CMasterBuffer[0] | (I2CMasterBuffer[1] << 8) |
+            (I2CMasterBuffer[2] << 16) | (I2CMasterBuffer[3] << 24),
+            I2CSlaveBuffer[0] | (I2CSlaveBuffer[1] << 8) |
+            (I2CSlaveBuffer[2] << 16) | (I2CSlaveBuffer[3] << 24));
 }
 
 void i2c_clearbuffers(void)
@@ -30,6 +30,8 @@
  * ARB_LOSS - Arbitration loss during any part of the transaction.
  *            This could only happen in a multi master system or could also
  *            identify a hardware problem in the system.
+ * TIMEOUT  - The transaction didn't reach any of the above in MAX_TIMEOUT
+ *            polls, e.g. SDA or SCL held low.
  */
 #define I2CSTATE_IDLE     0x000
 #define I2CSTATE_PENDING  0x001
@@ -37,6 +39,7 @@
 #define I2CSTATE_NACK     0x102
 #define I2CSTATE_SLA_NACK 0x103
 #define I2CSTATE_ARB_LOSS 0x104
+#define I2CSTATE_TIMEOUT  0x105
 
 #define FAST_MODE_PLUS	0
 
@@ -47,6 +50,9 @@
 #define I2CMASTER		0x01
 #define I2CSLAVE		0x02
 
+#define I2CBUS1			1
+#define I2CBUS2			2
+
 #define PCF8594_ADDR	0xA0
 #define READ_WRITE		0x01
 
@@ -76,7 +82,9 @@ extern volatile uint8_t I2CSlaveBuffer[Slave_Buffer_BUFSIZE];
 extern volatile uint32_t I2CReadLength, I2CWriteLength;
 
 extern uint32_t I2CInit( uint32_t I2cMode );
+extern uint32_t I2CInitBus( uint32_t bus );
 extern uint32_t I2CEngine( void );
+extern uint32_t I2CEngineBus( uint32_t bus );
 
 void i2c_showbuffers(void);
 void i2c_clearbuffers(void);
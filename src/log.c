@@ -0,0 +1,85 @@
+/*
+===============================================================================
+ Name        : log.c
+ Author      : Upi Tamminen
+ Version     : 1.0
+ Copyright   : Upi Tamminen (2012)
+ Description : deferred binary logging
+===============================================================================
+*/
+
+#ifdef __USE_CMSIS
+#include "LPC17xx.h"
+#endif
+
+#include <cr_section_macros.h>
+
+#include "log.h"
+#include "timer.h"
+#include "pack.h"
+#include "type.h"
+
+static __BSS(RAM2) uint8_t log_ring[LOG_SIZE];
+static uint32_t log_head, log_tail; /* free running */
+static uint32_t log_dropped;
+
+/* a full ring drops the new record, the old ones explain how it got full */
+void log_write(uint8_t id, uint8_t nargs, uint32_t a, uint32_t b,
+        uint32_t c)
+{
+    uint8_t rec[LOG_MAX_RECORD], *p = rec;
+    uint32_t i, n;
+
+    *p++ = id;
+    *p++ = nargs;
+    p = pack32(p, timer_ms());
+    if (nargs > 0) p = pack32(p, a);
+    if (nargs > 1) p = pack32(p, b);
+    if (nargs > 2) p = pack32(p, c);
+    n = p - rec;
+
+    if (LOG_SIZE - (log_head - log_tail) < n) {
+        log_dropped ++;
+        return;
+    }
+    for (i = 0; i < n; i ++) {
+        log_ring[(log_head + i) % LOG_SIZE] = rec[i];
+    }
+    log_head += n;
+}
+
+uint32_t log_pending(void)
+{
+    return log_head != log_tail || log_dropped;
+}
+
+/*
+ * Move whole records to buf, as many as fit in max bytes. A count of
+ * dropped records goes first if there are any.
+ */
+uint32_t log_read(uint8_t *buf, uint32_t max)
+{
+    uint8_t *p = buf;
+    uint32_t i, n;
+
+    if (log_dropped && max >= 10) {
+        *p++ = LOG_DROPPED;
+        *p++ = 1;
+        p = pack32(p, timer_ms());
+        p = pack32(p, log_dropped);
+        log_dropped = 0;
+    }
+    while (log_tail != log_head) {
+        n = 6 + 4 * log_ring[(log_tail + 1) % LOG_SIZE];
+        if (p + n > buf + max) {
+            break;
+        }
+        for (i = 0; i < n; i ++) {
+            *p++ = log_ring[(log_tail + i) % LOG_SIZE];
+        }
+        log_tail += n;
+    }
+    return p - buf;
+}
+
+/* vim: set et sw=4: */
@@ -0,0 +1,42 @@
+#ifndef __LOG_H
+#define __LOG_H
+
+#include "type.h"
+
+/*
+ * Diagnostics as binary records in a RAM ring instead of printf, so that
+ * logging costs a few cycles instead of a semihosting stall. The host
+ * expands them (utils/camlog.py), keep the ids in sync with it.
+ *
+ * Record: id (u8), argument count (u8), timer_ms() (u32), arguments (u32)
+ */
+#define LOG_SIZE 512 /* ring, a power of two */
+#define LOG_MAX_RECORD (6 + 3 * 4)
+
+#define LOG_DROPPED         0x00 /* records (didn't fit) */
+#define LOG_BOOT            0x01 /* cclk */
+#define LOG_I2C_INIT_FAILED 0x02
+#define LOG_CAM_INIT        0x03 /* camera */
+#define LOG_CAM_BAD_PID     0x04 /* camera, pid */
+#define LOG_CAM_READY       0x05 /* camera */
+#define LOG_I2C_ERROR       0x06 /* bus, register, state */
+#define LOG_I2C_BUFFERS     0x07 /* state, master, slave (first 4 bytes) */
+#define LOG_BAD_COMMAND     0x08 /* length */
+#define LOG_CAPTURE_FAILED  0x09 /* camera, error, lines */
+#define LOG_CAM_RECOVER     0x0a /* camera */
+#define LOG_WDT_RESET       0x0b
+
+#define LOG0(id) log_write(id, 0, 0, 0, 0)
+#define LOG1(id, a) log_write(id, 1, a, 0, 0)
+#define LOG2(id, a, b) log_write(id, 2, a, b, 0)
+#define LOG3(id, a, b, c) log_write(id, 3, a, b, c)
+
+/* not from interrupt handlers, the ring has a single writer */
+void log_write(uint8_t id, uint8_t nargs, uint32_t a, uint32_t b,
+        uint32_t c);
+uint32_t log_pending(void);
+uint32_t log_read(uint8_t *buf, uint32_t max);
+
+#endif
+
+/* vim: set et sw=4: */
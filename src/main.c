@@ -29,77 +29,324 @@ __CRP const unsigned int CRP_WORD = CRP_NO_CRP ;
 #include "type.h"
 #include "i2c.h"
 #include "uart0.h"
+#include "stats.h"
+#include "timer.h"
+#include "stream.h"
+#include "edge.h"
+#include "blob.h"
+#include "proto.h"
+#include "log.h"
+#include "boot.h"
+#include "perf.h"
+#include "wdt.h"
+#include "power.h"
+#include "mem.h"
+
+/* there's only room for one rgb565 qqvga frame or two luma ones, bigger
+ * modes are cut to what fits. The buffers come from the arena when a mode
+ * is set, see mem.h. A second sensor captures in turns */
+struct ov7670_store store;
+
+struct ov7670 cams[] = {
+    /* D0..D7 on P2.0..P2.7, vsync P2.8, href P2.11, pclk P2.12,
+     * reset on P0.22, sccb on I2C1 */
+    { 0, { 2, 0, 8, 11, 12, 0, 22 }, I2CBUS1, OV7670_ADDR, &store },
+#ifdef SECOND_CAMERA
+    /* D0..D7 on P1.18..P1.25, vsync P1.26, href P1.28, pclk P1.29
+     * (P1.27 is CLKOUT), reset on P0.21, sccb on I2C2 since both answer
+     * to the same address */
+    { 1, { 1, 18, 26, 28, 29, 0, 21 }, I2CBUS2, OV7670_ADDR, &store },
+#endif
+};
+
+#define NUM_CAMS (sizeof(cams) / sizeof(cams[0]))
 
 void init_board(void)
 {
-    /* clkout of 10mhz on 1.27 */
+    uint8_t x;
+
+    /* clkout on 1.27, cclk / OV7670_XCLK_DIV */
     LPC_PINCON->PINSEL3 &=~(3<<22);
     LPC_PINCON->PINSEL3 |= (1<<22);
-    LPC_SC->CLKOUTCFG = (1<<8)|(14<<4); //enable and divide by 12
+    LPC_SC->CLKOUTCFG = (1<<8)|((OV7670_XCLK_DIV - 1)<<4);
+
+    timer_init();
+
+    /* the sensors reset while everything else is set up */
+    for (x = 0; x < NUM_CAMS; x ++) {
+        ov7670_reset(&cams[x]);
+    }
 
     UART0_Init(921600);
 
     if (I2CInit((uint32_t) I2CMASTER) == 0) {
-        printf("Fatal error!\n");
+        LOG0(LOG_I2C_INIT_FAILED);
         while (1);
     }
+#ifdef SECOND_CAMERA
+    I2CInitBus(I2CBUS2);
+#endif
 }
 
 int main(void)
 {
     uint8_t addr1, addr2; /* i2c addresses */
+    uint8_t val;
     uint16_t x, y;
+    struct ov7670 *cam = &cams[0];
+    const struct ov7670_mode *mode;
+    struct mem_usage usage;
+    struct ov7670_frame *f;
+    uint32_t fps, n, t;
+    uint8_t format;
     char buf[128]; /* temporary string buffer for various stuff */
+    char *p;
 
     /* uart stuff */
-    char rcvbuf[32], c;
+    char rcvbuf[32];
+    int c;
     uint8_t rcvbufpos = 0;
 
     init_board();
-    ov7670_init();
+    boot_mark(BOOT_BOARD);
+    for (x = 0; x < NUM_CAMS; x ++) {
+        ov7670_init(&cams[x]);
+    }
+    boot_mark(BOOT_CAMS);
+    proto_init(cams, NUM_CAMS);
 
-    printf("Camtest says hi!\n");
-    printf("System clock: [%d]\n", SystemCoreClock);
+    LOG1(LOG_BOOT, SystemCoreClock);
+    /* captures and i2c give up on their own, this is for everything else */
+    if (wdt_init(WDT_TIMEOUT_MS)) {
+        LOG0(LOG_WDT_RESET);
+    }
 
     UART0_PrintString("Camtest says hi!\r\n");
+    boot_mark(BOOT_MAIN_LOOP);
     while (1) {
-        c = UART0_Getchar();
+        wdt_feed();
+        stream_poll();
+
+        c = UART0_Pollchar();
         if (c == EOF) {
+            proto_idle();
+            /* sensors to soft sleep and the core to sleep if nothing is
+             * due, see power.c */
+            power_idle(cams, NUM_CAMS, stream_wait());
+            continue;
+        } else if (proto_feed(c)) {
+            /* binary request, see proto.h */
             continue;
         } else if ((c >= 32) && (c <= 126)) {
-            rcvbuf[rcvbufpos++] = c;
+            if (rcvbufpos < sizeof(rcvbuf) - 1) {
+                rcvbuf[rcvbufpos++] = c;
+            }
         } else if (c == 13) {
+            t = timer_cycles();
             rcvbuf[rcvbufpos++] = 0;
             rcvbufpos = 0;
             if (strcmp(rcvbuf, "getimage") == 0) {
-                ov7670_readframe();
+                /* ERR and one of OV7670_ERR_ if the capture failed */
+                x = ov7670_readframe(cam);
+                if (x == OV7670_OK) {
+                    UART0_PrintString("OK\r\n");
+                } else {
+                    sprintf(buf, "ERR %d\r\n", x);
+                    UART0_PrintString(buf);
+                }
+            } else if (strncmp(rcvbuf, "stream on", 9) == 0 &&
+                    (rcvbuf[9] == 0 || rcvbuf[9] == ' ')) {
+                /* stream on [fps] [format], fps 0 = as fast as possible */
+                fps = strtoul(rcvbuf + 9, &p, 10);
+                while (*p == ' ') p ++;
+                format = *p ? stream_format(p) : STREAM_RAW;
+                if (stream_start(cams, NUM_CAMS, fps, format)) {
+                    UART0_PrintString("OK\r\n");
+                } else {
+                    UART0_PrintString("ERR\r\n");
+                }
+            } else if (strcmp(rcvbuf, "stream off") == 0) {
+                stream_stop();
+                UART0_PrintString("OK\r\n");
+            } else if (strcmp(rcvbuf, "stats") == 0) {
+                /* stats of the last captured frame, see stats.h */
+                f = cam->store->front;
+                if (f->stats.pixels) {
+                    y = stats_pack(&f->stats, (uint8_t *) buf);
+                    for (x = 0; x < y; x ++) {
+                        UART0_Sendchar(buf[x]);
+                    }
+                } else {
+                    UART0_PrintString("ERR\r\n");
+                }
+            } else if (strcmp(rcvbuf, "info") == 0) {
+                y = ov7670_pack_info(cam, (uint8_t *) buf);
+                for (x = 0; x < y; x ++) {
+                    UART0_Sendchar(buf[x]);
+                }
+            } else if (strcmp(rcvbuf, "linebytes") == 0) {
+                for (y = 0; y < OV7670_MAX_LINES; y ++) {
+                    UART0_Sendchar(cam->store->front->info.linebytes[y]);
+                    UART0_Sendchar(cam->store->front->info.linebytes[y] >> 8);
+                }
+            } else if (strlen(rcvbuf) == 5 &&
+                    strncmp(rcvbuf, "cam ", 4) == 0) {
+                /* select the sensor for the following commands */
+                x = atoi(rcvbuf + 4);
+                if (x < NUM_CAMS) {
+                    cam = &cams[x];
+                    UART0_PrintString("OK\r\n");
+                } else {
+                    UART0_PrintString("ERR\r\n");
+                }
+            } else if (strcmp(rcvbuf, "mode") == 0) {
+                /* name, width, height & format of the active mode, the
+                 * height is what fits in the frame store */
+                y = cam->mode->height;
+                n = pixel_columns(cam->mode->format, cam->mode->width);
+                if (n * y > cam->store->size) {
+                    y = cam->store->size / n;
+                }
+                sprintf(buf, "%s %d %d %d\r\n", cam->mode->name,
+                        cam->mode->width, y, cam->mode->format);
+                UART0_PrintString(buf);
+            } else if (strlen(rcvbuf) > 5 &&
+                    strncmp(rcvbuf, "mode ", 5) == 0) {
+                mode = ov7670_find_mode(rcvbuf + 5);
+                if (mode && ov7670_set_mode(cam, mode)) {
+                    UART0_PrintString("OK\r\n");
+                } else {
+                    UART0_PrintString("ERR\r\n");
+                }
+            } else if (strcmp(rcvbuf, "modes") == 0) {
+                /* name, width, height, format, fps, cycles per pclk */
+                for (x = 0; x < OV7670_NUM_MODES; x ++) {
+                    mode = &ov7670_modes[x];
+                    n = ov7670_mode_fps10(mode);
+                    sprintf(buf, "%s %d %d %d %d.%d %d\r\n", mode->name,
+                            mode->width, mode->height, mode->format,
+                            (int) (n / 10), (int) (n % 10),
+                            (int) ov7670_mode_cycles(mode));
+                    UART0_PrintString(buf);
+                }
+                UART0_PrintString("OK\r\n");
+            } else if (strcmp(rcvbuf, "mem") == 0) {
+                /* name, size, used & free bytes of each bank of the
+                 * arena, with the buffers of the active mode in it */
+                for (x = 0; x < MEM_BANKS; x ++) {
+                    mem_usage(x, &usage);
+                    sprintf(buf, "%s %d %d %d\r\n", usage.name,
+                            (int) usage.size, (int) usage.used,
+                            (int) usage.free);
+                    UART0_PrintString(buf);
+                }
                 UART0_PrintString("OK\r\n");
+            } else if (strncmp(rcvbuf, "getthumb ", 9) == 0) {
+                /* getthumb <level> [luma], sent with a stream header */
+                x = strtoul(rcvbuf + 9, &p, 10);
+                while (*p == ' ') p ++;
+                if (!stream_send_thumb(cam, x, strcmp(p, "luma") == 0)) {
+                    UART0_PrintString("ERR\r\n");
+                }
+            } else if (strncmp(rcvbuf, "getedges", 8) == 0) {
+                /* getedges [threshold], sent with a stream header */
+                x = rcvbuf[8] == ' ' ?
+                    strtoul(rcvbuf + 9, NULL, 10) : EDGE_THRESHOLD;
+                if (!stream_send_edges(cam, x)) {
+                    UART0_PrintString("ERR\r\n");
+                }
+            } else if (strncmp(rcvbuf, "getpreview", 10) == 0) {
+                /* getpreview [palette], one byte per pixel with a stream
+                 * header */
+                if (!stream_send_quant(cam,
+                            strcmp(rcvbuf + 10, " palette") == 0)) {
+                    UART0_PrintString("ERR\r\n");
+                }
+            } else if (strncmp(rcvbuf, "blobcolor ", 10) == 0) {
+                /* blobcolor <class> <rmin> <rmax> <gmin> <gmax> <bmin>
+                 * <bmax> in rgb565 units, or blobcolor <class> off */
+                x = strtoul(rcvbuf + 10, &p, 10);
+                while (*p == ' ') p ++;
+                if (x < BLOB_CLASSES && strcmp(p, "off") == 0) {
+                    blob_clear_class(x);
+                    UART0_PrintString("OK\r\n");
+                } else {
+                    for (y = 0; y < 6; y ++) {
+                        buf[y] = strtoul(p, &p, 10);
+                    }
+                    if (blob_set_class(x, buf[0], buf[1], buf[2], buf[3],
+                                buf[4], buf[5])) {
+                        UART0_PrintString("OK\r\n");
+                    } else {
+                        UART0_PrintString("ERR\r\n");
+                    }
+                }
+            } else if (strncmp(rcvbuf, "getblobs", 8) == 0) {
+                /* getblobs [min area], sent with a stream header */
+                n = rcvbuf[8] == ' ' ?
+                    strtoul(rcvbuf + 9, NULL, 10) : BLOB_MIN_AREA;
+                if (!stream_send_blobs(cam, n)) {
+                    UART0_PrintString("ERR\r\n");
+                }
             } else if (strlen(rcvbuf) >= 9 &&
                     strncmp(rcvbuf, "getline ", 8) == 0) {
                 y = atoi(rcvbuf + 8);
-                for (x = 0; x < 160; x ++) {
-                    UART0_Sendchar(qqvgaframe1[x + (y * 160)]);
-                    UART0_Sendchar(qqvgaframe2[x + (y * 160)]);
+                f = cam->store->front;
+                if (y < f->height) {
+                    /* bayer pairs go out interleaved like rgb565 */
+                    t = pixel_columns(f->format, f->width);
+                    n = y * t;
+                    for (x = 0; x < t; x ++) {
+                        UART0_Sendchar(f->plane1[n + x]);
+                        if (f->plane2) {
+                            UART0_Sendchar(f->plane2[n + x]);
+                        }
+                    }
                 }
             } else if (strlen(rcvbuf) == 9 &&
                     strncmp(rcvbuf, "regr 0x", 7) == 0) {
                 addr1 = strtoul(rcvbuf + 7, NULL, 16);
-                sprintf(buf, "0x%.2x 0x%.2x\r\n", addr1, ov7670_get(addr1));
-                printf("%s", buf);
-                UART0_PrintString(buf);
+                if (ov7670_get(cam, addr1, &val) != I2CSTATE_ACK) {
+                    UART0_PrintString("ERR\r\n");
+                } else {
+                    sprintf(buf, "0x%.2x 0x%.2x\r\n", addr1, val);
+                    UART0_PrintString(buf);
+                }
             } else if (strlen(rcvbuf) == 14 &&
                     strncmp(rcvbuf, "regw 0x", 7) == 0) {
                 strncpy(buf, rcvbuf + 7, 2);
                 buf[2] = 0;
                 addr1 = strtoul((char *) buf, NULL, 16);
                 addr2 = strtoul(rcvbuf + 12, NULL, 16);
-                ov7670_set(addr1, addr2);
+                ov7670_set(cam, addr1, addr2);
                 sprintf(buf, "0x%.2x 0x%.2x\r\n", addr1, addr2);
                 UART0_PrintString(buf);
+            } else if (strcmp(rcvbuf, "boot") == 0) {
+                /* microseconds from reset to each checkpoint, 0 = not yet */
+                for (x = 0; x < BOOT_NUM; x ++) {
+                    sprintf(buf, "%s %lu\r\n", boot_names[x],
+                            (unsigned long) boot_us(x));
+                    UART0_PrintString(buf);
+                }
+                UART0_PrintString("OK\r\n");
+            } else if (strcmp(rcvbuf, "log") == 0) {
+                /* binary, as a PROTO_LOG reply */
+                proto_send_log(0);
+            } else if (strcmp(rcvbuf, "perf") == 0 ||
+                    strcmp(rcvbuf, "perf reset") == 0) {
+                /* binary snapshot, see perf_pack(), then the reset */
+                y = perf_pack((uint8_t *) buf);
+                for (x = 0; x < y; x ++) {
+                    UART0_Sendchar(buf[x]);
+                }
+                if (rcvbuf[4]) {
+                    perf_reset();
+                }
             } else {
                 UART0_PrintString("ERR\r\n");
-                printf("Unknown command: [%s]\n", rcvbuf);
+                LOG1(LOG_BAD_COMMAND, strlen(rcvbuf));
             }
+            perf_command(t);
         }
     }
 
@@ -0,0 +1,127 @@
+/*
+===============================================================================
+ Name        : mem.c
+ Author      : Upi Tamminen
+ Version     : 1.0
+ Copyright   : Upi Tamminen (2012)
+ Description : region allocator for the mode dependent buffers
+===============================================================================
+*/
+
+#include <cr_section_macros.h>
+
+#include "mem.h"
+#include "type.h"
+
+/*
+ * Everything sized by the active mode comes from here and is let go all
+ * at once when the mode changes, so there's no free(). Main sram is
+ * handed out from the bottom up. The ahb region is handed out from both
+ * ends, bank 0 from the bottom and bank 1 from the top, so the two meet
+ * wherever the sizes say.
+ */
+static uint32_t mem_main[MEM_MAIN_SIZE / 4];
+static __BSS(RAM2) uint32_t mem_ahb[MEM_AHB_SIZE / 4];
+
+static uint8_t *mem_main_next;
+static uint8_t *mem_ahb_lo, *mem_ahb_hi;
+
+/* fallbacks when the preferred bank is full */
+static const uint8_t mem_order[MEM_BANKS][MEM_BANKS] = {
+    { MEM_MAIN, MEM_AHB0, MEM_AHB1 },
+    { MEM_AHB0, MEM_AHB1, MEM_MAIN },
+    { MEM_AHB1, MEM_AHB0, MEM_MAIN },
+};
+
+void mem_reset(void)
+{
+    mem_main_next = (uint8_t *) mem_main;
+    mem_ahb_lo = (uint8_t *) mem_ahb;
+    mem_ahb_hi = (uint8_t *) mem_ahb + sizeof(mem_ahb);
+}
+
+static uint8_t *mem_take(uint8_t bank, uint32_t size)
+{
+    uint8_t *p;
+
+    if (bank == MEM_MAIN) {
+        if ((uint32_t) ((uint8_t *) mem_main + sizeof(mem_main) -
+                    mem_main_next) < size) {
+            return NULL;
+        }
+        p = mem_main_next;
+        mem_main_next += size;
+        return p;
+    }
+    if ((uint32_t) (mem_ahb_hi - mem_ahb_lo) < size) {
+        return NULL;
+    }
+    if (bank == MEM_AHB0) {
+        p = mem_ahb_lo;
+        mem_ahb_lo += size;
+    } else {
+        mem_ahb_hi -= size;
+        p = mem_ahb_hi;
+    }
+    return p;
+}
+
+/*
+ * size bytes, word aligned, from bank or the next best one with room.
+ * NULL if nothing has.
+ */
+void *mem_alloc(uint32_t size, uint8_t bank)
+{
+    uint8_t *p;
+    uint32_t i;
+
+    if (!mem_main_next) {
+        mem_reset();
+    }
+    size = (size + 3) & ~3;
+    for (i = 0; i < MEM_BANKS; i ++) {
+        p = mem_take(mem_order[bank][i], size);
+        if (p) {
+            return p;
+        }
+    }
+    return NULL;
+}
+
+/* bytes of [start, end) inside [lo, hi) */
+static uint32_t mem_overlap(uint32_t start, uint32_t end,
+        uint32_t lo, uint32_t hi)
+{
+    if (start < lo) start = lo;
+    if (end > hi) end = hi;
+    return end > start ? end - start : 0;
+}
+
+/* how much of the arena is in a bank and how much of that is taken */
+void mem_usage(uint8_t bank, struct mem_usage *u)
+{
+    static const char * const names[MEM_BANKS] = { "main", "ahb0", "ahb1" };
+    uint32_t base = (uint32_t) mem_ahb, top = base + sizeof(mem_ahb);
+    uint32_t lo = MEM_AHB_START, hi = MEM_AHB1_START;
+
+    if (!mem_main_next) {
+        mem_reset();
+    }
+    u->name = names[bank];
+    if (bank == MEM_MAIN) {
+        u->size = sizeof(mem_main);
+        u->used = mem_main_next - (uint8_t *) mem_main;
+        u->free = u->size - u->used;
+        return;
+    }
+    if (bank == MEM_AHB1) {
+        lo = MEM_AHB1_START;
+        hi = MEM_AHB_END;
+    }
+    u->size = mem_overlap(base, top, lo, hi);
+    u->free = mem_overlap((uint32_t) mem_ahb_lo, (uint32_t) mem_ahb_hi,
+            lo, hi);
+    u->used = u->size - u->free;
+}
+
+/* vim: set et sw=4: */
@@ -0,0 +1,42 @@
+#ifndef __MEM_H
+#define __MEM_H
+
+#include "type.h"
+
+/*
+ * Banks of the arena. Main sram is on the cpu's own bus, the fastest for
+ * it and free of dma traffic, but the gpdma can't reach it. The two ahb
+ * banks are back to back, a buffer can straddle them.
+ */
+#define MEM_MAIN 0
+#define MEM_AHB0 1
+#define MEM_AHB1 2
+#define MEM_BANKS 3
+
+#define MEM_AHB_START 0x2007c000
+#define MEM_AHB1_START 0x20080000
+#define MEM_AHB_END 0x20084000
+
+/* what the old fixed qqvga buffers took in each, the rest of main sram
+ * is the stack and the rest of ahb sram the log & protocol buffers */
+#define MEM_MAIN_SIZE 21600
+#define MEM_AHB_SIZE 28800
+
+struct mem_usage {
+    const char *name;
+    uint32_t size, used, free;
+};
+
+/* buffers the gpdma can send from */
+static inline uint32_t mem_dma(const void *p)
+{
+    return (uint32_t) p >= MEM_AHB_START && (uint32_t) p < MEM_AHB_END;
+}
+
+void mem_reset(void);
+void *mem_alloc(uint32_t size, uint8_t bank);
+void mem_usage(uint8_t bank, struct mem_usage *u);
+
+#endif
+
+/* vim: set et sw=4: */
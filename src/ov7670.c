@@ -16,220 +16,816 @@
 #include <NXP/crp.h>
 
 #include <stdio.h>
+#include <string.h>
 
 #include "ov7670.h"
 #include "ov7670reg.h"
 #include "type.h"
 #include "i2c.h"
 #include "delay.h"
+#include "timer.h"
+#include "pack.h"
+#include "log.h"
+#include "boot.h"
+#include "perf.h"
+#include "power.h"
+#include "mem.h"
+#include "stats.h"
 
-/* use these to check if pin is high */
-#define ST_D0 (LPC_GPIO2->FIOPIN & (1 << 0))
-#define ST_D1 (LPC_GPIO2->FIOPIN & (1 << 1))
-#define ST_D2 (LPC_GPIO2->FIOPIN & (1 << 2))
-#define ST_D3 (LPC_GPIO2->FIOPIN & (1 << 3))
-#define ST_D4 (LPC_GPIO2->FIOPIN & (1 << 4))
-#define ST_D5 (LPC_GPIO2->FIOPIN & (1 << 5))
-#define ST_D6 (LPC_GPIO2->FIOPIN & (1 << 6))
-#define ST_D7 (LPC_GPIO2->FIOPIN & (1 << 7))
+/*
+ * The capture loop needs roughly OV7670_FAST_CYCLES per pixel clock
+ * (OV7670_CAPTURE_CYCLES without byte aligned data pins), so every mode
+ * is paired with the clock prescaler (CLKRC) that keeps it above that.
+ * Neither figure is measured yet, so no mode is faster than it was with
+ * the generic loop alone: ov7670_line_fast() only adds margin for now.
+ * Lower the prescaler only after measuring the line times.
+ *
+ * Frames taller than the frame store are cut at the bottom.
+ */
+const struct ov7670_mode ov7670_modes[] = {
+    /* name, width, height, format, com7, clkrc,
+     * com3, com14, dcw, pclkdiv,
+     * hstart, hstop, href, vstart, vstop, vref */
+    { "qqvga", 160, 120, FMT_RGB565, COM7_RGB, 0x80,
+        COM3_DCWEN, 0x1a, 0x22, 0xf2, /* downsample & divide by 4 */
+        0x16, 0x04, 0x24, 0x02, 0x7a, 0x0a },
+    { "qqvga-yuv", 160, 120, FMT_YUV422, COM7_YUV, 0x80,
+        COM3_DCWEN, 0x1a, 0x22, 0xf2,
+        0x16, 0x04, 0x24, 0x02, 0x7a, 0x0a },
+    { "qqvga-luma", 160, 120, FMT_LUMA, COM7_YUV, 0x80, /* y of yuv */
+        COM3_DCWEN, 0x1a, 0x22, 0xf2,
+        0x16, 0x04, 0x24, 0x02, 0x7a, 0x0a },
+    { "qqvga-slow", 160, 120, FMT_RGB565, COM7_RGB, 0x81,
+        COM3_DCWEN, 0x1a, 0x22, 0xf2,
+        0x16, 0x04, 0x24, 0x02, 0x7a, 0x0a },
+    { "qcif", 176, 144, FMT_RGB565, COM7_FMT_QCIF | COM7_RGB, 0x81,
+        COM3_SCALEEN | COM3_DCWEN, 0x11, 0x11, 0xf1, /* by 2 */
+        0x16, 0x04, 0xa4, 0x02, 0x7a, 0x0a },
+    { "qvga", 320, 240, FMT_RGB565, COM7_RGB, 0x81,
+        COM3_DCWEN, 0x19, 0x11, 0xf1, /* downsample & divide by 2 */
+        0x16, 0x04, 0x24, 0x02, 0x7a, 0x0a },
+    { "qvga-yuv", 320, 240, FMT_YUV422, COM7_YUV, 0x81,
+        COM3_DCWEN, 0x19, 0x11, 0xf1,
+        0x16, 0x04, 0x24, 0x02, 0x7a, 0x0a },
+    /* bayer is vga only, this is the middle 320x240 window of it; one
+     * byte per pixel clock and no pclk divider, so clkrc divides by 4 */
+    { "qvga-bayer", 320, 240, FMT_BAYER, COM7_PBAYER, 0x83,
+        0x00, 0x00, 0x00, 0xf0,
+        0x27, 0x4f, 0xb6, 0x20, 0x5c, 0x0a },
+};
+
+static LPC_GPIO_TypeDef * const ov7670_ports[] = {
+    LPC_GPIO0, LPC_GPIO1, LPC_GPIO2, LPC_GPIO3, LPC_GPIO4
+};
+
+/* two PINSEL/PINMODE registers per port, two bits per pin */
+static void ov7670_pin_gpio(uint8_t port, uint8_t pin)
+{
+    (&LPC_PINCON->PINSEL0)[port * 2 + pin / 16] &= ~(3 << ((pin % 16) * 2));
+}
 
-#define ST_VSYNC (LPC_GPIO2->FIOPIN & (1 << 8))
-#define ST_HREF (LPC_GPIO2->FIOPIN & (1 << 11))
-#define ST_PCLK (LPC_GPIO2->FIOPIN & (1 << 12))
+static void ov7670_pin_nopull(uint8_t port, uint8_t pin)
+{
+    volatile uint32_t *mode = &(&LPC_PINCON->PINMODE0)[port * 2 + pin / 16];
 
-/* due to memory constraints, only read the upper half of the image */
-uint8_t qqvgaframe1[QQVGA_HEIGHT * QQVGA_WIDTH]; /* first rgb565 byte */
-__DATA(RAM2) uint8_t qqvgaframe2[QQVGA_HEIGHT * QQVGA_WIDTH]; /* second rgb565 byte */
+    *mode &= ~(1 << ((pin % 16) * 2));
+    *mode |= (2 << ((pin % 16) * 2));
+}
 
-uint32_t ov7670_set(uint8_t addr, uint8_t val)
+uint32_t ov7670_set(struct ov7670 *cam, uint8_t addr, uint8_t val)
 {
+    uint32_t state;
+
     i2c_clearbuffers();
 
     I2CWriteLength = 3;
     I2CReadLength = 0;
-    I2CMasterBuffer[0] = OV7670_ADDR;   /* i2c address */
+    I2CMasterBuffer[0] = cam->addr;     /* i2c address */
     I2CMasterBuffer[1] = addr;          /* key */
     I2CMasterBuffer[2] = val;           /* value */
 
-    return I2CEngine();
+    state = I2CEngineBus(cam->bus);
+    if (state != I2CSTATE_ACK) {
+        LOG3(LOG_I2C_ERROR, cam->bus, addr, state);
+    }
+    return state;
 }
 
-uint8_t ov7670_get(uint8_t addr)
+/*
+ * Reads one register into *val, a sensor that stays silent for
+ * OV7670_SCCB_RETRIES attempts fails the read with the last i2c state.
+ */
+uint32_t ov7670_get(struct ov7670 *cam, uint8_t addr, uint8_t *val)
 {
+    uint32_t state;
+    int i;
+
     i2c_clearbuffers();
     I2CWriteLength = 2;
     I2CReadLength = 0;
-    I2CMasterBuffer[0] = OV7670_ADDR;   /* i2c address */
+    I2CMasterBuffer[0] = cam->addr;     /* i2c address */
     I2CMasterBuffer[1] = addr;          /* key */
 
-    I2CEngine();
+    state = I2CEngineBus(cam->bus);
+    if (state != I2CSTATE_ACK) {
+        LOG3(LOG_I2C_ERROR, cam->bus, addr, state);
+        return state;
+    }
 
     delay(1);
 
     i2c_clearbuffers();
     I2CWriteLength = 0;
     I2CReadLength = 1;
-    I2CMasterBuffer[0] = OV7670_ADDR | RD_BIT;
+    I2CMasterBuffer[0] = cam->addr | RD_BIT;
 
-    while (I2CEngine() == I2CSTATE_SLA_NACK);
+    for (i = 0; i < OV7670_SCCB_RETRIES; i++) {
+        state = I2CEngineBus(cam->bus);
+        if (state != I2CSTATE_SLA_NACK) {
+            break;
+        }
+    }
+    /* one record per failed read, not per attempt */
+    if (state != I2CSTATE_ACK) {
+        LOG3(LOG_I2C_ERROR, cam->bus, addr, state);
+        return state;
+    }
 
-    return I2CSlaveBuffer[0];
+    *val = I2CSlaveBuffer[0];
+    return state;
 }
 
-void ov7670_init(void)
+#define OV7670_STORE_BUSY(s) ((s)->slots[0].busy || (s)->slots[1].busy)
+
+/* wait for the slots to be sent, 0 if one is still locked on timeout */
+static uint8_t ov7670_store_idle(struct ov7670_store *s)
 {
-    printf("Initializing ov7670");
+    uint32_t t0 = timer_ms();
 
-    /* 0.22 used to reset the camera */
-    LPC_PINCON->PINSEL1 &= ~(3 << 12); /* set as gpio */
-    LPC_GPIO0->FIODIR |= (1 << 22); /* set as output */
-    LPC_PINCON->PINMODE1 &= ~(1 << 12); /* no pulldown/up */
-    LPC_PINCON->PINMODE1 |= (1 << 13); /* no pulldown/up */
+    while (OV7670_STORE_BUSY(s)) {
+        if (timer_ms() - t0 > OV7670_FRAME_TIMEOUT_MS) {
+            return 0;
+        }
+        POWER_SLEEP_UNLESS(!OV7670_STORE_BUSY(s));
+    }
+    return 1;
+}
 
-    /* ports D0..D7 go to P2.0..P2.7 */
-    LPC_PINCON->PINSEL4 &= ~(0xffff); /* function = gpio */
-    LPC_GPIO2->FIODIR &= ~(0xff); /* direction = input */
+/* split the buffers into slots for a pixel format, 0 if they are busy */
+static uint8_t ov7670_store_layout(struct ov7670_store *s, uint8_t format)
+{
+    uint8_t n = format == FMT_LUMA ? 2 : 1;
 
-    /* port 2.8 vsync */
-    LPC_PINCON->PINSEL4 &= ~(3 << 16); /* function = gpio */
-    LPC_GPIO2->FIODIR &= ~(1 << 8); /* direction = input */
+    if (s->nslots == n) {
+        return 1;
+    }
+    if (!ov7670_store_idle(s)) {
+        return 0;
+    }
 
-    /* port 2.11 href */
-    LPC_PINCON->PINSEL4 &= ~(3 << 22); /* function = gpio */
-    LPC_GPIO2->FIODIR &= ~(1 << 11); /* direction = input */
+    memset(s->slots, 0, sizeof(s->slots));
+    s->slots[0].plane1 = s->buf1;
+    s->slots[0].size = s->size;
+    if (n == 2) {
+        s->slots[1].plane1 = s->buf2;
+        s->slots[1].size = s->size;
+    } else {
+        s->slots[0].plane2 = s->buf2;
+    }
+    s->nslots = n;
+    s->front = &s->slots[0];
+    s->back = &s->slots[n - 1];
+    return 1;
+}
 
-    /* port 2.12 pclk */
-    LPC_PINCON->PINSEL4 &= ~(3 << 24); /* function = gpio */
-    LPC_GPIO2->FIODIR &= ~(1 << 12); /* direction = input */
+/*
+ * Size the store for a mode from an emptied arena, as many lines as fit
+ * in both buffers next to the thumbnails. The sensor writes two byte
+ * formats to main sram and an ahb bank at the same time, which are on
+ * different buses. Luma slots are sent with dma, so they go to the ahb
+ * banks, a slot that doesn't fit there ends up in main sram and is sent
+ * by the cpu. Returns the number of lines, 0 if the old buffers were
+ * still being sent and the store was left alone.
+ */
+uint32_t ov7670_store_alloc(struct ov7670_store *s,
+        const struct ov7670_mode *mode)
+{
+    uint32_t w = pixel_columns(mode->format, mode->width);
+    uint32_t lines, thumbs;
+    uint8_t luma = mode->format == FMT_LUMA;
 
-    printf("...reset");
-    LPC_GPIO0->FIOCLR |= (1 << 22); /* low */
-    delay(100);
-    LPC_GPIO0->FIOSET |= (1 << 22); /* high */
-    delay(100);
+    /* nothing may be sent from the old buffers any more */
+    if (!ov7670_store_idle(s)) {
+        return 0;
+    }
 
-    printf("...settings");
-    if (ov7670_get(REG_PID) != 0x76) {
-        printf("PANIC! REG_PID != 0x76!\n");
-        while (1);
+    /* thumbnails of everything but bayer, see stream_build_thumbs() */
+    thumbs = mode->format != FMT_BAYER;
+    for (lines = mode->height; lines > 0; lines --) {
+        mem_reset();
+        s->buf1 = mem_alloc(w * lines, luma ? MEM_AHB0 : MEM_MAIN);
+        s->buf2 = mem_alloc(w * lines, MEM_AHB1);
+        s->thumb_size = thumbs ? (mode->width / 2) * (lines / 2) * 2 : 0;
+        s->thumb1 = thumbs ? mem_alloc(s->thumb_size, MEM_AHB0) : NULL;
+        s->thumb2 = thumbs ? mem_alloc(s->thumb_size / 4, MEM_MAIN) : NULL;
+        if (s->buf1 && s->buf2 && (s->thumb1 || !thumbs) &&
+                (s->thumb2 || !thumbs)) {
+            break;
+        }
     }
-    ov7670_set(REG_COM7, 0x80); /* reset to default values */
-    ov7670_set(REG_CLKRC, 0x80);
-    ov7670_set(REG_COM11, 0x0A);
-    ov7670_set(REG_TSLB, 0x04);
-    ov7670_set(REG_TSLB, 0x04);
-    ov7670_set(REG_COM7, 0x04); /* output format: rgb */
+    s->size = w * lines;
+    s->mode = mode;
+    s->nslots = 0;
+    ov7670_store_layout(s, mode->format);
+    return lines;
+}
 
-    ov7670_set(REG_RGB444, 0x00); /* disable RGB444 */
-    ov7670_set(REG_COM15, 0xD0); /* set RGB565 */
+/*
+ * Set up the pins and start the reset pulse. The rest of the board can be
+ * initialized while it runs, ov7670_init() ends it.
+ */
+void ov7670_reset(struct ov7670 *cam)
+{
+    struct ov7670_pins *pins = &cam->pins;
+    LPC_GPIO_TypeDef *reset = ov7670_ports[pins->reset_port];
+    uint8_t i;
+
+    cam->gpio = ov7670_ports[pins->port];
+    cam->vsync = 1 << pins->vsync;
+    cam->href = 1 << pins->href;
+    cam->pclk = 1 << pins->pclk;
+
+    /* byte wide views of FIOPIN for ov7670_line_fast(), the data pins have
+     * to be a whole byte and href & pclk in another one */
+    cam->fast_data = NULL;
+    cam->fast_ctrl = NULL;
+    if (pins->d0 % 8 == 0 && pins->href / 8 == pins->pclk / 8) {
+        cam->fast_data = (volatile uint8_t *) &cam->gpio->FIOPIN +
+            pins->d0 / 8;
+        cam->fast_ctrl = (volatile uint8_t *) &cam->gpio->FIOPIN +
+            pins->href / 8;
+        cam->fast_href = 1 << (pins->href % 8);
+        cam->fast_pclk = 1 << (pins->pclk % 8);
+    }
 
-    /* not even sure what all these do, gonna check the oscilloscope and go
-     * from there... */
-    ov7670_set(REG_HSTART, 0x16);
-    ov7670_set(REG_HSTOP, 0x04);
-    ov7670_set(REG_HREF, 0x24);
-    ov7670_set(REG_VSTART, 0x02);
-    ov7670_set(REG_VSTOP, 0x7a);
-    ov7670_set(REG_VREF, 0x0a);
-    ov7670_set(REG_COM10, 0x02);
-    ov7670_set(REG_COM3, 0x04);
-    ov7670_set(REG_COM14, 0x1a); // divide by 4
-    //ov7670_set(REG_COM14, 0x1b); // divide by 8
-    ov7670_set(REG_MVFP, 0x27);
-    ov7670_set(0x72, 0x22); // downsample by 4
-    //ov7670_set(0x72, 0x33); // downsample by 8
-    ov7670_set(0x73, 0xf2); // divide by 4
-    //ov7670_set(0x73, 0xf3); // divide by 8
+    /* reset line */
+    ov7670_pin_gpio(pins->reset_port, pins->reset_pin);
+    reset->FIODIR |= (1 << pins->reset_pin); /* set as output */
+    ov7670_pin_nopull(pins->reset_port, pins->reset_pin);
+
+    /* D0..D7, vsync, href & pclk as gpio inputs */
+    for (i = 0; i < 8; i ++) {
+        ov7670_pin_gpio(pins->port, pins->d0 + i);
+    }
+    ov7670_pin_gpio(pins->port, pins->vsync);
+    ov7670_pin_gpio(pins->port, pins->href);
+    ov7670_pin_gpio(pins->port, pins->pclk);
+    cam->gpio->FIODIR &= ~((0xff << pins->d0) |
+            cam->vsync | cam->href | cam->pclk);
+
+    reset->FIOCLR = (1 << pins->reset_pin); /* low */
+    cam->reset_ms = timer_ms();
+
+    /* the end of a frame can wake the core, only ports 0 & 2 have edge
+     * interrupts, see OV7670_DOZE */
+    cam->vsync_int = NULL;
+    if (pins->port == 0) {
+        cam->vsync_int = &LPC_GPIOINT->IO0IntEnF;
+    } else if (pins->port == 2) {
+        cam->vsync_int = &LPC_GPIOINT->IO2IntEnF;
+    }
+    NVIC_EnableIRQ(EINT3_IRQn);
+}
+
+/* vsync edges are only there to end a WFI */
+void EINT3_IRQHandler(void)
+{
+    LPC_GPIOINT->IO0IntClr = LPC_GPIOINT->IO0IntStatF;
+    LPC_GPIOINT->IO2IntClr = LPC_GPIOINT->IO2IntStatF;
+}
+
+/* wait until at least ms milliseconds have passed since start */
+static void ov7670_wait(uint32_t start, uint32_t ms)
+{
+    while (timer_ms() - start <= ms);
+}
+
+uint8_t ov7670_init(struct ov7670 *cam)
+{
+    struct ov7670_pins *pins = &cam->pins;
+    LPC_GPIO_TypeDef *reset = ov7670_ports[pins->reset_port];
+    uint8_t val;
+
+    LOG1(LOG_CAM_INIT, cam->id);
+
+    ov7670_wait(cam->reset_ms, OV7670_RESET_MS);
+    reset->FIOSET = (1 << pins->reset_pin); /* high */
+    ov7670_wait(timer_ms(), OV7670_SETTLE_MS);
+
+    if (ov7670_get(cam, REG_PID, &val) != I2CSTATE_ACK) {
+        val = 0;
+    }
+    if (val != 0x76) {
+        LOG2(LOG_CAM_BAD_PID, cam->id, val);
+        /* captures time out and retry the init, see ov7670_recover() */
+        if (!cam->mode) {
+            cam->mode = &ov7670_modes[0];
+        }
+        if (cam->store->mode != cam->mode) {
+            ov7670_store_alloc(cam->store, cam->mode);
+        }
+        return OV7670_ERR_NODEV;
+    }
+    /* registers are at their defaults after the reset pulse, no need
+     * for a COM7 soft reset */
+    cam->asleep = 0;
+    cam->waking = 0;
+    ov7670_set(cam, REG_COM11, 0x0A);
+    ov7670_set(cam, REG_TSLB, 0x04);
+
+    ov7670_set(cam, REG_RGB444, 0x00); /* disable RGB444 */
+
+    ov7670_set(cam, REG_COM10, 0x02);
+    ov7670_set(cam, REG_MVFP, 0x27);
 
     // test pattern
-    //ov7670_set(0x70, 1 << 7);
-    //ov7670_set(0x70, 0x0);
+    //ov7670_set(cam, 0x70, 1 << 7);
+    //ov7670_set(cam, 0x70, 0x0);
 
     // COLOR SETTING
-    ov7670_set(0x4f, 0x80);
-    ov7670_set(0x50, 0x80);
-    ov7670_set(0x51, 0x00);
-    ov7670_set(0x52, 0x22);
-    ov7670_set(0x53, 0x5e);
-    ov7670_set(0x54, 0x80);
-    ov7670_set(0x56, 0x40);
-    ov7670_set(0x58, 0x9e);
-    ov7670_set(0x59, 0x88);
-    ov7670_set(0x5a, 0x88);
-    ov7670_set(0x5b, 0x44);
-    ov7670_set(0x5c, 0x67);
-    ov7670_set(0x5d, 0x49);
-    ov7670_set(0x5e, 0x0e);
-    ov7670_set(0x69, 0x00);
-    ov7670_set(0x6a, 0x40);
-    ov7670_set(0x6b, 0x0a);
-    ov7670_set(0x6c, 0x0a);
-    ov7670_set(0x6d, 0x55);
-    ov7670_set(0x6e, 0x11);
-    ov7670_set(0x6f, 0x9f);
-
-    ov7670_set(0xb0, 0x84);
-
-    printf("...done.\n");
-}
-
-void ov7670_readframe(void)
-{
-    while (ST_VSYNC); /* wait for the old frame to end */
-    while (!ST_VSYNC); /* wait for a new frame to start */
-
-    uint32_t i = 0;
-
-    while (ST_VSYNC) {
-        //if (y >= (QQVGA_HEIGHT / 2)) break;
-        while (ST_VSYNC && !ST_HREF); /* wait for a line to start */
-        if (!ST_VSYNC) break; /* line didn't start, but frame ended */
-        while (ST_HREF) { /* wait for a line to end */
-            /* first byte */
-            while (!ST_PCLK); /* wait for clock to go high */
-            /* no time to do anything fancy here! */
-            /* this grabs the first 8 bits, rest gets chopped off */
-            qqvgaframe1[i] = LPC_GPIO2->FIOPIN;
-            while (ST_PCLK); /* wait for clock to go back low */
-
-            /* second byte */
-            while (!ST_PCLK); /* wait for clock to go high */
-            qqvgaframe2[i] = LPC_GPIO2->FIOPIN;
-            while (ST_PCLK); /* wait for clock to go back low */
-            i ++;
+    ov7670_set(cam, 0x4f, 0x80);
+    ov7670_set(cam, 0x50, 0x80);
+    ov7670_set(cam, 0x51, 0x00);
+    ov7670_set(cam, 0x52, 0x22);
+    ov7670_set(cam, 0x53, 0x5e);
+    ov7670_set(cam, 0x54, 0x80);
+    ov7670_set(cam, 0x56, 0x40);
+    ov7670_set(cam, 0x58, 0x9e);
+    ov7670_set(cam, 0x59, 0x88);
+    ov7670_set(cam, 0x5a, 0x88);
+    ov7670_set(cam, 0x5b, 0x44);
+    ov7670_set(cam, 0x5c, 0x67);
+    ov7670_set(cam, 0x5d, 0x49);
+    ov7670_set(cam, 0x5e, 0x0e);
+    ov7670_set(cam, 0x69, 0x00);
+    ov7670_set(cam, 0x6a, 0x40);
+    ov7670_set(cam, 0x6b, 0x0a);
+    ov7670_set(cam, 0x6c, 0x0a);
+    ov7670_set(cam, 0x6d, 0x55);
+    ov7670_set(cam, 0x6e, 0x11);
+    ov7670_set(cam, 0x6f, 0x9f);
+
+    ov7670_set(cam, 0xb0, 0x84);
+
+    /* resolution, format & clock, and the store to match */
+    ov7670_set_mode(cam, &ov7670_modes[0]);
+
+    LOG1(LOG_CAM_READY, cam->id);
+    return OV7670_OK;
+}
+
+/* pulse the reset line and set the sensor up again, in the same mode */
+void ov7670_recover(struct ov7670 *cam)
+{
+    const struct ov7670_mode *mode = cam->mode;
+
+    LOG1(LOG_CAM_RECOVER, cam->id);
+    cam->failures = 0;
+    ov7670_reset(cam);
+    if (ov7670_init(cam) == OV7670_OK) {
+        ov7670_set_mode(cam, mode);
+    }
+}
+
+/*
+ * Soft sleep stops the outputs and keeps the registers, the sensor comes
+ * back in the same mode within a frame or two of ov7670_wake().
+ */
+void ov7670_sleep(struct ov7670 *cam)
+{
+    uint8_t com2;
+
+    if (cam->asleep) {
+        return;
+    }
+    if (ov7670_get(cam, REG_COM2, &com2) != I2CSTATE_ACK) {
+        return;
+    }
+    ov7670_set(cam, REG_COM2, com2 | COM2_SSLEEP);
+    cam->asleep = 1;
+    cam->sleep_ms = timer_ms();
+}
+
+void ov7670_wake(struct ov7670 *cam)
+{
+    uint8_t com2;
+
+    if (!cam->asleep) {
+        return;
+    }
+    if (ov7670_get(cam, REG_COM2, &com2) != I2CSTATE_ACK) {
+        return;
+    }
+    ov7670_set(cam, REG_COM2, com2 & ~COM2_SSLEEP);
+    cam->asleep = 0;
+    cam->waking = 1;
+    perf.sensor_sleep_ms += timer_ms() - cam->sleep_ms;
+    cam->sleep_ms = timer_ms();
+}
+
+/* how far ahead of a frame to wake the sensor */
+uint32_t ov7670_wake_ms(struct ov7670 *cam)
+{
+    uint32_t fps10 = ov7670_mode_fps10(cam->mode);
+
+    if (!fps10) {
+        return OV7670_FRAME_TIMEOUT_MS;
+    }
+    return OV7670_WAKE_FRAMES * 10000 / fps10 + 1;
+}
+
+/* frames per second of a mode, times ten */
+uint32_t ov7670_mode_fps10(const struct ov7670_mode *mode)
+{
+    uint32_t xclk = SystemCoreClock / OV7670_XCLK_DIV;
+
+    return xclk * 10 / ((mode->clkrc & CLK_SCALE) + 1) / OV7670_FRAME_CLOCKS;
+}
+
+/* cpu cycles between two pclk edges of the same polarity */
+uint32_t ov7670_mode_cycles(const struct ov7670_mode *mode)
+{
+    return OV7670_XCLK_DIV * ((mode->clkrc & CLK_SCALE) + 1) *
+        (1 << (mode->pclkdiv & 0x07));
+}
+
+const struct ov7670_mode *ov7670_find_mode(const char *name)
+{
+    uint32_t i;
+
+    for (i = 0; i < OV7670_NUM_MODES; i ++) {
+        if (strcmp(ov7670_modes[i].name, name) == 0) {
+            return &ov7670_modes[i];
         }
     }
+    return NULL;
+}
+
+/* cpu cycles per pixel clock the capture loop of a camera needs */
+uint32_t ov7670_capture_cycles(struct ov7670 *cam)
+{
+    return cam->fast_ctrl ? OV7670_FAST_CYCLES : OV7670_CAPTURE_CYCLES;
+}
+
+/*
+ * Switch resolution, format and frame rate. Refuses modes whose pixel
+ * clock is faster than the capture loop can follow, and fails without
+ * touching the sensor if the frame store can't be resized.
+ */
+uint32_t ov7670_set_mode(struct ov7670 *cam, const struct ov7670_mode *mode)
+{
+    if (ov7670_mode_cycles(mode) < ov7670_capture_cycles(cam)) {
+        return 0;
+    }
+    if (cam->store->mode != mode && !ov7670_store_alloc(cam->store, mode)) {
+        return 0;
+    }
+
+    ov7670_set(cam, REG_CLKRC, mode->clkrc);
+    ov7670_set(cam, REG_COM7, mode->com7);
+    ov7670_set(cam, REG_COM15, mode->format == FMT_RGB565 ?
+            COM15_R00FF | COM15_RGB565 : COM15_R00FF);
+
+    /* not even sure what all these do, gonna check the oscilloscope and go
+     * from there... */
+    ov7670_set(cam, REG_HSTART, mode->hstart);
+    ov7670_set(cam, REG_HSTOP, mode->hstop);
+    ov7670_set(cam, REG_HREF, mode->href);
+    ov7670_set(cam, REG_VSTART, mode->vstart);
+    ov7670_set(cam, REG_VSTOP, mode->vstop);
+    ov7670_set(cam, REG_VREF, mode->vref);
+
+    ov7670_set(cam, REG_COM3, mode->com3);
+    ov7670_set(cam, REG_COM14, mode->com14);
+    ov7670_set(cam, REG_SCALING_DCWCTR, mode->dcw);
+    ov7670_set(cam, REG_SCALING_PCLK_DIV, mode->pclkdiv);
+
+    cam->mode = mode;
+    return 1;
+}
+
+/* where ov7670_line_fast() left off */
+struct ov7670_line {
+    uint8_t *p1, *p2;
+    uint32_t step2;
+    uint32_t spins;     /* 0 if the pixel clock stalled */
+};
+
+/*
+ * One HREF line with the byte wide FIOPIN views, running from RAM so
+ * that flash wait states don't add jitter to the edge detection. Href is
+ * sampled together with the rising clock edge instead of on its own.
+ * Stores at most n pixels and returns how many were clocked in.
+ *
+ * Per pixel clock: the clock high wait (5 cycles a spin), a data load &
+ * store and the clock low wait, about 20 cycles at worst with the spin
+ * granularity, see OV7670_FAST_CYCLES.
+ */
+__RAMFUNC(RAM)
+static uint32_t ov7670_line_fast(struct ov7670 *cam, struct ov7670_line *l,
+        uint32_t n)
+{
+    const volatile uint8_t *d = cam->fast_data, *c = cam->fast_ctrl;
+    uint8_t href = cam->fast_href, pclk = cam->fast_pclk, v;
+    uint8_t *p1 = l->p1, *p2 = l->p2;
+    uint32_t step2 = l->step2, spins = l->spins, i = 0;
+
+    for (; i < n; i ++) {
+        /* first byte, until the clock goes high or the line ends */
+        do {
+            v = *c;
+            if (!--spins) goto out;
+        } while ((v & (href | pclk)) == href);
+        if (!(v & href)) goto out;
+        *p1++ = *d;
+        do { if (!--spins) goto out; } while (*c & pclk);
+
+        /* second byte */
+        do { if (!--spins) goto out; } while (!(*c & pclk));
+        *p2 = *d;
+        p2 += step2;
+        do { if (!--spins) goto out; } while (*c & pclk);
+    }
+
+    /* the frame store is full, only count the rest of the line */
+    while (1) {
+        do {
+            v = *c;
+            if (!--spins) goto out;
+        } while ((v & (href | pclk)) == href);
+        if (!(v & href)) goto out;
+        do { if (!--spins) goto out; } while (*c & pclk);
+        do { if (!--spins) goto out; } while (!(*c & pclk));
+        do { if (!--spins) goto out; } while (*c & pclk);
+        i ++;
+    }
+
+out:
+    l->p1 = p1;
+    l->p2 = p2;
+    l->spins = spins;
+    return i;
 }
 
-void ov7670_clear_buffers(void)
+/*
+ * Sensor frames that went by uncaptured in ms between two frame starts,
+ * from the frame rate of the mode: polling at a low rate skips frames,
+ * a stream at full rate shouldn't.
+ */
+static uint16_t ov7670_skipped(struct ov7670 *cam, uint32_t ms)
 {
-    uint16_t i;
+    uint32_t frames;
 
-    /* clear the buffers with zero.. a crude method to checking if the
-     * buffer is filled later with ov7670_check_missing.
-     * DOES NOT WORK IN DARK :D */
-    for (i = 0; i < QQVGA_HEIGHT * QQVGA_WIDTH; i ++) {
-        qqvgaframe1[i] = 0;
-        qqvgaframe2[i] = 0;
+    if (ms > 600000) {
+        return 0xffff;
     }
+    frames = (ms * ov7670_mode_fps10(cam->mode) + 5000) / 10000;
+    if (frames <= 1) {
+        return 0;
+    }
+    return frames - 1 > 0xffff ? 0xffff : frames - 1;
 }
 
-void ov7670_check_missing(void)
+/* frame and line starts, against a deadline from t0 */
+#define OV7670_WAIT(cond) \
+    while (cond) { \
+        if (timer_ms() - t0 > OV7670_FRAME_TIMEOUT_MS) goto failed; \
+    }
+
+/* the same for the end of a frame, which can take a whole one: asleep
+ * until the vsync edge if it has an interrupt */
+#define OV7670_DOZE(cond) \
+    while (cond) { \
+        if (timer_ms() - t0 > OV7670_FRAME_TIMEOUT_MS) goto failed; \
+        if (cam->vsync_int) POWER_SLEEP_UNLESS(!(cond)); \
+    }
+
+/* pixel clock edges, against the spin budget of the line, only a
+ * decrement in the loop */
+#define OV7670_SPIN(cond) \
+    while (cond) { \
+        if (!--spins) goto failed; \
+    }
+
+/*
+ * Capture into the back slot of the store, waiting for it if it's still
+ * being sent, and make it the front one when the frame is complete.
+ *
+ * Every wait is bounded, a stalled or missing sensor returns one of the
+ * OV7670_ERR_ values instead of hanging. After OV7670_MAX_FAILURES in a
+ * row the sensor is reset and set up again. A sensor in soft sleep is
+ * woken first.
+ */
+uint8_t ov7670_readframe(struct ov7670 *cam)
 {
-    uint32_t m;
-    uint16_t i;
+    LPC_GPIO_TypeDef *gpio = cam->gpio;
+    struct ov7670_store *s = cam->store;
+    struct ov7670_frame *f;
+    struct ov7670_frameinfo *info;
+    uint32_t vsync = cam->vsync, href = cam->href, pclk = cam->pclk;
+    uint8_t shift = cam->pins.d0;
+    uint32_t i = 0, start, step2 = 1;
+    uint16_t line = 0;
+    uint8_t b1, b2, *p1, *p2, *end, discard, err;
+    uint32_t t_frame, t_line, line_max = 0;
+    uint64_t line_sum = 0;
+    uint32_t t0, spins, line_spins;
+    struct ov7670_line l;
+
+    /* a send that never completes would leave the slots locked */
+    err = OV7670_ERR_BUSY;
+    /* sensors sharing the store can be in different modes */
+    if (s->mode != cam->mode && !ov7670_store_alloc(s, cam->mode)) {
+        goto failed;
+    }
+    if (!ov7670_store_layout(s, cam->mode->format)) {
+        goto failed;
+    }
+    f = s->back;
+    info = &f->info;
+    t0 = timer_ms();
+    while (f->busy) {
+        if (timer_ms() - t0 > OV7670_FRAME_TIMEOUT_MS) goto failed;
+        POWER_SLEEP_UNLESS(!f->busy);
+    }
+    ov7670_wake(cam);
+
+    /* luma keeps only the first byte of every pixel */
+    p1 = f->plane1;
+    p2 = f->plane2;
+    end = p1 + f->size;
+    if (!p2) {
+        p2 = &discard;
+        step2 = 0;
+    }
+
+    /* a line takes width * 2 pixel clocks and a spin is at least three
+     * cycles, so this leaves a margin of three lines */
+    line_spins = cam->mode->width * 2 * ov7670_mode_cycles(cam->mode);
 
-    m = 0;
-    for (i = 0; i < 19200; i ++) {
-        if (qqvgaframe1[i] == 0) m ++;
+    t0 = timer_ms();
+    err = OV7670_ERR_VSYNC;
+    /* wait for the old frame to end */
+    if (cam->vsync_int) {
+        *cam->vsync_int |= vsync;
+    }
+    OV7670_DOZE(gpio->FIOPIN & vsync);
+    if (cam->vsync_int) {
+        *cam->vsync_int &= ~vsync;
+    }
+    /* wait for a new frame to start */
+    OV7670_WAIT(!(gpio->FIOPIN & vsync));
+    t_frame = perf_cycles();
+
+    info->timestamp = timer_ms();
+    info->skipped = 0;
+    if (cam->waking) {
+        perf_wake(info->timestamp - cam->sleep_ms);
+        cam->waking = 0;
+    } else if (cam->last_ms) {
+        info->skipped = ov7670_skipped(cam, info->timestamp - cam->last_ms);
+    }
+    f->format = cam->mode->format;
+    f->width = cam->mode->width;
+    f->height = cam->mode->height;
+    if (pixel_columns(f->format, f->width) * f->height > f->size) {
+        f->height = f->size / pixel_columns(f->format, f->width);
     }
-    printf("Missing pixels in frame 1: %d\n", m);
 
-    m = 0;
-    for (i = 0; i < 19200; i ++) {
-        if (qqvgaframe2[i] == 0) m ++;
+    while (gpio->FIOPIN & vsync) {
+        /* wait for a line to start */
+        err = OV7670_ERR_VSYNC;
+        OV7670_WAIT((gpio->FIOPIN & (vsync | href)) == vsync);
+        /* line didn't start, but frame ended */
+        if (!(gpio->FIOPIN & vsync)) break;
+        t_line = perf_cycles();
+        start = i;
+        err = OV7670_ERR_PCLK;
+        spins = line_spins;
+        if (cam->fast_ctrl) {
+            l.p1 = p1;
+            l.p2 = p2;
+            l.step2 = step2;
+            l.spins = spins;
+            i += ov7670_line_fast(cam, &l, end - p1);
+            if (!l.spins) goto failed;
+            p1 = l.p1;
+            p2 = l.p2;
+        } else {
+            /* for data pins that aren't a whole byte */
+            while (gpio->FIOPIN & href) { /* wait for a line to end */
+                /* first byte */
+                OV7670_SPIN(!(gpio->FIOPIN & pclk)); /* clock goes high */
+                /* no time to do anything fancy here! */
+                /* this grabs the 8 data bits, rest gets chopped off */
+                b1 = gpio->FIOPIN >> shift;
+                OV7670_SPIN(gpio->FIOPIN & pclk); /* back low */
+
+                /* second byte */
+                OV7670_SPIN(!(gpio->FIOPIN & pclk)); /* clock goes high */
+                b2 = gpio->FIOPIN >> shift;
+                /* store while the clock is high, keep counting past the end
+                 * so that a misconfigured sensor shows up in the line info */
+                if (p1 < end) {
+                    *p1++ = b1;
+                    *p2 = b2;
+                    p2 += step2;
+                }
+                i ++;
+                OV7670_SPIN(gpio->FIOPIN & pclk); /* back low */
+            }
+        }
+        /* the line blanking has time for the bookkeeping */
+        t_line = perf_cycles() - t_line;
+        line_sum += t_line;
+        if (t_line > line_max) line_max = t_line;
+        if (line < OV7670_MAX_LINES) {
+            info->linebytes[line] = (i - start) * 2;
+        }
+        line ++;
+    }
+    perf_capture(perf_cycles() - t_frame, line, line_sum, line_max);
+
+    info->lines = line;
+    for (start = line; start < OV7670_MAX_LINES; start ++) {
+        info->linebytes[start] = 0;
+    }
+    info->bytes = i * 2;
+    info->seq = ++s->seq;
+    /* taken now, so they can't mix this frame with the next one */
+    if (f->format == FMT_RGB565) {
+        stats_compute(&f->stats, f->plane1, f->plane2,
+                f->width * f->height);
+    } else {
+        f->stats.pixels = 0;
+    }
+    boot_mark(BOOT_FIRST_FRAME);
+
+    s->back = s->front;
+    s->front = f;
+    cam->failures = 0;
+    cam->last_ms = info->timestamp;
+    return OV7670_OK;
+
+failed:
+    if (cam->vsync_int) {
+        *cam->vsync_int &= ~vsync;
+    }
+    /* the slot isn't swapped in, a single slot store is left with a
+     * partly overwritten frame */
+    LOG3(LOG_CAPTURE_FAILED, cam->id, err, line);
+    if (++cam->failures >= OV7670_MAX_FAILURES) {
+        ov7670_recover(cam);
+    }
+    return err;
+}
+
+/*
+ * Summary of the last frame for the host, little endian:
+ * seq, timestamp, bytes (u32), lines, shortest line, longest line,
+ * the number of lines not matching the frame width and the sensor frames
+ * skipped before it (u16)
+ */
+uint32_t ov7670_pack_info(struct ov7670 *cam, uint8_t *buf)
+{
+    struct ov7670_frameinfo *info = &cam->store->front->info;
+    uint8_t *p = buf;
+    uint16_t i, n, minbytes = 0xffff, maxbytes = 0, badlines = 0;
+
+    n = info->lines;
+    if (n > OV7670_MAX_LINES) n = OV7670_MAX_LINES;
+
+    for (i = 0; i < n; i ++) {
+        if (info->linebytes[i] < minbytes)
+            minbytes = info->linebytes[i];
+        if (info->linebytes[i] > maxbytes)
+            maxbytes = info->linebytes[i];
+        if (info->linebytes[i] != pixel_columns(cam->store->front->format,
+                    cam->store->front->width) * 2)
+            badlines ++;
     }
-    printf("Missing pixels in frame 2: %d\n", m);
+    if (n == 0) minbytes = 0;
+
+    p = pack32(p, info->seq);
+    p = pack32(p, info->timestamp);
+    p = pack32(p, info->bytes);
+    p = pack16(p, info->lines);
+    p = pack16(p, minbytes);
+    p = pack16(p, maxbytes);
+    p = pack16(p, badlines);
+    p = pack16(p, info->skipped);
+
+    return p - buf;
 }
 
 /* vim: set et sw=4: */
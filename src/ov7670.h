@@ -1,24 +1,186 @@
 #ifndef __OV7670_H 
 #define __OV7670_H
 
+#ifdef __USE_CMSIS
+#include "LPC17xx.h"
+#endif
+
 #include "type.h"
 #include "ov7670reg.h"
 #include "i2c.h"
+#include "pixel.h"
+#include "stats.h"
 
 #define OV7670_ADDR     0x42
 
 #define QQVGA_HEIGHT 120
 #define QQVGA_WIDTH 160
 
-extern uint8_t qqvgaframe1[QQVGA_HEIGHT * QQVGA_WIDTH];
-extern __DATA(RAM2) uint8_t qqvgaframe2[QQVGA_HEIGHT * QQVGA_WIDTH];
+/* CLKOUT divider feeding XCLK, see init_board() */
+#define OV7670_XCLK_DIV 15
+
+/* internal clocks per frame, 784x510 at 2 clocks per pixel */
+#define OV7670_FRAME_CLOCKS (784 * 510 * 2)
+
+/*
+ * cpu cycles per pixel clock the capture loops need, with some margin:
+ * the generic one for data pins at any offset and ov7670_line_fast() for
+ * a byte aligned port. Both are counted from the instructions, not
+ * measured, so no mode relies on the fast one: the modes run at 60
+ * cycles per pixel clock, qqvga-slow at 120 (see the "modes" command).
+ * Measure the line times (perf, or a scope on pclk) before lowering a
+ * prescaler.
+ */
+#define OV7670_CAPTURE_CYCLES 40
+#define OV7670_FAST_CYCLES 24
+
+
+/* reset pulse and the wait before the first sccb access, the datasheet
+ * asks for 1 ms each */
+#define OV7670_RESET_MS 2
+#define OV7670_SETTLE_MS 2
+
+/* a frame start or line start later than this fails the capture, two
+ * frames of the slowest mode */
+#define OV7670_FRAME_TIMEOUT_MS 600
+
+/* read attempts a register gets while the sensor does not ack its
+ * address, bounded so a missing sensor can't hang the init */
+#define OV7670_SCCB_RETRIES 3
+
+/* failed captures in a row before the sensor is reset */
+#define OV7670_MAX_FAILURES 3
+
+/* frames a sensor is woken from soft sleep ahead of a scheduled one */
+#define OV7670_WAKE_FRAMES 2
+
+/* ov7670_readframe() & ov7670_init() results */
+#define OV7670_OK        0
+#define OV7670_ERR_VSYNC 1 /* no frame or line started in time */
+#define OV7670_ERR_PCLK  2 /* pixel clock stopped within a line */
+#define OV7670_ERR_NODEV 3 /* no sensor answering with the right pid */
+#define OV7670_ERR_BUSY  4 /* the slot was still being sent */
+
+/* HREF lines tracked per frame, anything past this is only counted */
+#define OV7670_MAX_LINES 240
+
+/* size of the packed summary from ov7670_pack_info() */
+#define OV7670_INFO_SIZE 22
+
+/* filled in by ov7670_readframe() */
+struct ov7670_frameinfo {
+    uint32_t seq;       /* increments on every captured frame */
+    uint32_t timestamp; /* timer_ms() when the frame started */
+    uint32_t bytes;     /* bytes clocked in, including ones not stored */
+    uint16_t lines;     /* HREF lines seen */
+    uint16_t skipped;   /* sensor frames since the last capture, estimated */
+    uint16_t linebytes[OV7670_MAX_LINES]; /* bytes per HREF line */
+};
+
+/* a frame slot of the store */
+struct ov7670_frame {
+    uint8_t *plane1;    /* first byte of every pixel */
+    uint8_t *plane2;    /* second byte, NULL for luma */
+    uint32_t size;      /* bytes in each plane */
+    uint16_t width, height; /* of the frame in the slot */
+    uint8_t format;
+    volatile uint8_t busy; /* being sent, don't capture over it */
+    struct ov7670_frameinfo info;
+    struct frame_stats stats; /* rgb565 only, pixels is 0 otherwise */
+};
+
+/*
+ * Two buffers make up the frame store. Two byte formats need both of them
+ * for a single slot, so capture and transfer take turns. Luma frames fit
+ * in one, so there are two slots: the sensor fills the back one while the
+ * host reads the front one, and they are swapped when a frame is complete.
+ *
+ * The buffers and the thumbnails come from the arena (see mem.h), sized
+ * for the mode they were set up for. Can be shared by sensors that
+ * capture alternately.
+ */
+struct ov7670_store {
+    uint8_t *buf1, *buf2;
+    uint32_t size;      /* bytes in each buffer */
+    uint8_t *thumb1, *thumb2; /* half & quarter size, NULL if none */
+    uint32_t thumb_size; /* bytes in thumb1, thumb2 has a quarter */
+    const struct ov7670_mode *mode; /* the buffers are sized for */
+    struct ov7670_frame slots[2];
+    uint8_t nslots;
+    uint32_t seq;       /* of the last captured frame */
+    struct ov7670_frame *front; /* last complete frame */
+    struct ov7670_frame *back;  /* captured into, same as front if single */
+};
+
+/* resolution, format & frame rate preset */
+struct ov7670_mode {
+    const char *name;
+    uint16_t width, height;
+    uint8_t format;
+    uint8_t com7;
+    uint8_t clkrc;      /* internal clock prescaler */
+    uint8_t com3, com14;
+    uint8_t dcw;        /* downsampling, SCALING_DCWCTR */
+    uint8_t pclkdiv;    /* SCALING_PCLK_DIV */
+    uint8_t hstart, hstop, href, vstart, vstop, vref;
+};
+
+#define OV7670_NUM_MODES 8
+
+extern const struct ov7670_mode ov7670_modes[OV7670_NUM_MODES];
+
+/*
+ * D0..D7 must be on consecutive pins of the same port as VSYNC, HREF and
+ * PCLK, so that a single FIOPIN read samples all of them
+ */
+struct ov7670_pins {
+    uint8_t port;
+    uint8_t d0;         /* D1..D7 follow */
+    uint8_t vsync, href, pclk;
+    uint8_t reset_port, reset_pin;
+};
+
+struct ov7670 {
+    uint8_t id;         /* reported to the host with every frame */
+    struct ov7670_pins pins;
+    uint8_t bus;        /* I2CBUS1 or I2CBUS2 */
+    uint8_t addr;       /* sccb address */
+    struct ov7670_store *store;
+
+    /* set up by ov7670_reset() & ov7670_init() */
+    const struct ov7670_mode *mode;
+    LPC_GPIO_TypeDef *gpio;
+    uint32_t vsync, href, pclk; /* pin masks */
+    const volatile uint8_t *fast_data, *fast_ctrl; /* NULL if not aligned */
+    uint8_t fast_href, fast_pclk; /* masks within fast_ctrl */
+    uint32_t reset_ms;  /* when the reset pulse started */
+    uint8_t failures;   /* captures failed in a row */
+    volatile uint32_t *vsync_int; /* falling edge enables, NULL if none */
+
+    /* soft sleep, see power.c */
+    uint8_t asleep;
+    uint8_t waking;     /* woken, the first frame hasn't started yet */
+    uint32_t sleep_ms;  /* when it went to sleep or was woken */
+    uint32_t last_ms;   /* start of the last captured frame */
+};
 
-uint32_t ov7670_set(uint8_t addr, uint8_t val);
-uint8_t ov7670_get(uint8_t addr);
-void ov7670_init(void);
-void ov7670_readframe(void);
-void ov7670_clear_buffers(void);
-void ov7670_check_missing(void);
+uint32_t ov7670_set(struct ov7670 *cam, uint8_t addr, uint8_t val);
+uint32_t ov7670_get(struct ov7670 *cam, uint8_t addr, uint8_t *val);
+void ov7670_reset(struct ov7670 *cam);
+uint8_t ov7670_init(struct ov7670 *cam);
+void ov7670_recover(struct ov7670 *cam);
+uint32_t ov7670_set_mode(struct ov7670 *cam, const struct ov7670_mode *mode);
+uint32_t ov7670_store_alloc(struct ov7670_store *s,
+        const struct ov7670_mode *mode);
+const struct ov7670_mode *ov7670_find_mode(const char *name);
+uint32_t ov7670_mode_fps10(const struct ov7670_mode *mode);
+uint32_t ov7670_mode_cycles(const struct ov7670_mode *mode);
+uint32_t ov7670_capture_cycles(struct ov7670 *cam);
+void ov7670_sleep(struct ov7670 *cam);
+void ov7670_wake(struct ov7670 *cam);
+uint32_t ov7670_wake_ms(struct ov7670 *cam);
+uint8_t ov7670_readframe(struct ov7670 *cam);
+uint32_t ov7670_pack_info(struct ov7670 *cam, uint8_t *buf);
 
 #endif
 
@@ -111,6 +111,10 @@
 #define REG_REG76       0x76    /* OV's name */
 #define R76_BLKPCOR     0x80    /* Black pixel correction enable */
 #define R76_WHTPCOR     0x40    /* White pixel correction enable */
+#define REG_SCALING_XSC 0x70    /* Horizontal scale, test pattern */
+#define REG_SCALING_YSC 0x71    /* Vertical scale, test pattern */
+#define REG_SCALING_DCWCTR 0x72 /* Downsample control */
+#define REG_SCALING_PCLK_DIV 0x73 /* DSP clock divider */
 #define REG_RGB444      0x8c    /* RGB 444 control */
 #define R444_ENABLE     0x02    /* Turn on RGB444, overrides 5x5 */
 #define R444_RGBX       0x01    /* Empty nibble at end */
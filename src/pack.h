@@ -0,0 +1,23 @@
+#ifndef __PACK_H
+#define __PACK_H
+
+#include "type.h"
+
+/* little endian helpers for building replies to the host */
+
+static inline uint8_t *pack16(uint8_t *p, uint16_t v)
+{
+    *p++ = v;
+    *p++ = v >> 8;
+    return p;
+}
+
+static inline uint8_t *pack32(uint8_t *p, uint32_t v)
+{
+    p = pack16(p, v);
+    return pack16(p, v >> 16);
+}
+
+#endif
+
+/* vim: set et sw=4: */
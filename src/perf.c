@@ -0,0 +1,103 @@
+/*
+===============================================================================
+ Name        : perf.c
+ Author      : Upi Tamminen
+ Version     : 1.0
+ Copyright   : Upi Tamminen (2012)
+ Description : performance counters
+===============================================================================
+*/
+
+#ifdef __USE_CMSIS
+#include "LPC17xx.h"
+#endif
+
+#include <string.h>
+
+#include "perf.h"
+#include "pack.h"
+#include "timer.h"
+#include "type.h"
+
+struct perf_counters perf;
+
+/* a frame is done, line times were collected by the capture loop */
+void perf_capture(uint32_t cycles, uint32_t lines, uint64_t line_sum,
+        uint32_t line_max)
+{
+    perf.frames ++;
+    perf.capture_sum += cycles;
+    if (cycles > perf.capture_max) {
+        perf.capture_max = cycles;
+    }
+    perf.lines += lines;
+    perf.line_sum += line_sum;
+    if (line_max > perf.line_max) {
+        perf.line_max = line_max;
+    }
+}
+
+/* a command that was complete at start (timer_cycles(), which keeps
+ * counting while a capture sleeps) has been answered */
+void perf_command(uint32_t start)
+{
+    uint32_t cycles = timer_cycles() - start;
+
+    perf.commands ++;
+    perf.command_sum += cycles;
+    if (cycles > perf.command_max) {
+        perf.command_max = cycles;
+    }
+}
+
+/* the core slept, cycles as counted by timer_cycles() */
+void perf_sleep(uint32_t cycles)
+{
+    perf.sleep_cycles += cycles;
+}
+
+/* a sensor out of soft sleep started its first frame */
+void perf_wake(uint32_t ms)
+{
+    perf.wakes ++;
+    perf.wake_sum_ms += ms;
+    if (ms > perf.wake_max_ms) {
+        perf.wake_max_ms = ms;
+    }
+}
+
+void perf_reset(void)
+{
+    memset(&perf, 0, sizeof(perf));
+    perf.reset_ms = timer_ms();
+}
+
+uint32_t perf_pack(uint8_t *buf)
+{
+    uint8_t *p = buf;
+
+    p = pack32(p, perf.frames);
+    p = pack32(p, perf.frames ? perf.capture_sum / perf.frames : 0);
+    p = pack32(p, perf.capture_max);
+    p = pack32(p, perf.lines);
+    p = pack32(p, perf.lines ? perf.line_sum / perf.lines : 0);
+    p = pack32(p, perf.line_max);
+    p = pack32(p, perf.tx_bytes);
+    p = pack32(p, perf.uart_overrun);
+    p = pack32(p, perf.uart_framing);
+    p = pack32(p, perf.i2c_nack);
+    p = pack32(p, perf.i2c_arb_loss);
+    p = pack32(p, perf.commands);
+    p = pack32(p, perf.commands ? perf.command_sum / perf.commands : 0);
+    p = pack32(p, perf.command_max);
+    p = pack32(p, timer_ms() - perf.reset_ms);
+    p = pack32(p, perf.sleep_cycles / (SystemCoreClock / 1000));
+    p = pack32(p, perf.sensor_sleep_ms);
+    p = pack32(p, perf.wakes);
+    p = pack32(p, perf.wakes ? perf.wake_sum_ms / perf.wakes : 0);
+    p = pack32(p, perf.wake_max_ms);
+    p = pack32(p, SystemCoreClock);
+    return p - buf;
+}
+
+/* vim: set et sw=4: */
@@ -0,0 +1,58 @@
+#ifndef __PERF_H
+#define __PERF_H
+
+#ifdef __USE_CMSIS
+#include "LPC17xx.h"
+#endif
+
+#include "type.h"
+
+/*
+ * Counters for the device under load. Times are in DWT cycles, started
+ * in ResetISR (see boot.c), the snapshot carries cclk to convert them.
+ */
+struct perf_counters {
+    uint32_t frames;
+    uint64_t capture_sum;
+    uint32_t capture_max;   /* vsync to vsync, one frame */
+    uint32_t lines;
+    uint64_t line_sum;
+    uint32_t line_max;      /* href high, one line */
+    uint32_t tx_bytes;
+    uint32_t uart_overrun, uart_framing;
+    uint32_t i2c_nack, i2c_arb_loss;
+    uint32_t commands;      /* text & binary */
+    uint64_t command_sum;
+    uint32_t command_max;   /* received to replied, timer_cycles() */
+    uint64_t sleep_cycles;  /* core in WFI, from timer_cycles() */
+    uint32_t sensor_sleep_ms; /* soft sleep, of all sensors together */
+    uint32_t wakes;
+    uint32_t wake_sum_ms;
+    uint32_t wake_max_ms;   /* sensor woken to its first frame */
+    uint32_t reset_ms;      /* timer_ms() at perf_reset() */
+};
+
+/* frames, capture avg & max, lines, line avg & max, tx bytes,
+ * uart overrun & framing errors, i2c nack & arbitration loss, commands,
+ * command avg & max, ms since the reset, ms the core slept, ms the
+ * sensors slept, wakes, wake avg & max in ms, cclk (u32 each) */
+#define PERF_PACKED_SIZE (21 * 4)
+
+extern struct perf_counters perf;
+
+static inline uint32_t perf_cycles(void)
+{
+    return DWT->CYCCNT;
+}
+
+void perf_capture(uint32_t cycles, uint32_t lines, uint64_t line_sum,
+        uint32_t line_max);
+void perf_command(uint32_t start);
+void perf_sleep(uint32_t cycles);
+void perf_wake(uint32_t ms);
+void perf_reset(void);
+uint32_t perf_pack(uint8_t *buf);
+
+#endif
+
+/* vim: set et sw=4: */
@@ -0,0 +1,51 @@
+#ifndef __PIXEL_H
+#define __PIXEL_H
+
+#include "type.h"
+
+/* pixel formats, as reported to the host */
+#define FMT_RGB565 0x01
+#define FMT_YUV422 0x02 /* y u y v */
+#define FMT_LUMA   0x03 /* 8 bit grey */
+#define FMT_EDGES  0x04 /* 1 bit per pixel, msb first, rows byte aligned */
+#define FMT_BLOBS  0x05 /* blob records instead of pixels, see blob.h */
+#define FMT_BAYER  0x06 /* 8 bit raw bayer, one colour per pixel */
+#define FMT_RGB332 0x07 /* rrrgggbb */
+#define FMT_PALETTE 0x08 /* 256 rgb565 entries, then 8 bit indices */
+
+/*
+ * Entries per row in each plane of a captured frame. Bayer pixels are
+ * clocked in as pairs like rgb565 ones, the even columns go to the first
+ * plane and the odd ones to the second.
+ */
+static inline uint32_t pixel_columns(uint8_t format, uint32_t width)
+{
+    return format == FMT_BAYER ? width / 2 : width;
+}
+
+/* rgb565 pixels are captured as two bytes, red is in the top of the first */
+
+static inline uint32_t rgb565_r(uint8_t hi, uint8_t lo)
+{
+    return hi >> 3;
+}
+
+static inline uint32_t rgb565_g(uint8_t hi, uint8_t lo)
+{
+    return ((hi & 0x07) << 3) | (lo >> 5);
+}
+
+static inline uint32_t rgb565_b(uint8_t hi, uint8_t lo)
+{
+    return lo & 0x1f;
+}
+
+/* bt.601 weights scaled to 8 bit, 0..250 */
+static inline uint32_t rgb565_luma(uint32_t r, uint32_t g, uint32_t b)
+{
+    return (r * 616 + g * 600 + b * 232) >> 8;
+}
+
+#endif
+
+/* vim: set et sw=4: */
@@ -0,0 +1,47 @@
+/*
+===============================================================================
+ Name        : power.c
+ Author      : Upi Tamminen
+ Version     : 1.0
+ Copyright   : Upi Tamminen (2012)
+ Description : sensor soft sleep & core sleep between requests
+===============================================================================
+*/
+
+#ifdef __USE_CMSIS
+#include "LPC17xx.h"
+#endif
+
+#include "power.h"
+#include "ov7670.h"
+#include "uart0.h"
+#include "timer.h"
+#include "type.h"
+
+/*
+ * Called from the main loop when it has nothing to do, next_ms is the
+ * time to the next scheduled frame. Sensors that have been idle for
+ * POWER_IDLE_MS go to soft sleep and are woken early enough to have
+ * frames coming again when it's due. Then the core sleeps until uart rx,
+ * a dma transfer or the next tick, unless a frame is due now.
+ *
+ * Only the plain sleep mode: deep sleep stops the PLL, and restarting it
+ * would lose bytes at 921600 baud.
+ */
+void power_idle(struct ov7670 *cams, uint8_t ncams, uint32_t next_ms)
+{
+    uint32_t i, now = timer_ms();
+
+    for (i = 0; i < ncams; i ++) {
+        if (next_ms <= ov7670_wake_ms(&cams[i])) {
+            ov7670_wake(&cams[i]);
+        } else if (now - cams[i].last_ms > POWER_IDLE_MS) {
+            ov7670_sleep(&cams[i]);
+        }
+    }
+    if (next_ms) {
+        POWER_SLEEP_UNLESS(UART0_Available());
+    }
+}
+
+/* vim: set et sw=4: */
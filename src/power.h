@@ -0,0 +1,34 @@
+#ifndef __POWER_H
+#define __POWER_H
+
+#ifdef __USE_CMSIS
+#include "LPC17xx.h"
+#endif
+
+#include "type.h"
+#include "ov7670.h"
+#include "timer.h"
+#include "perf.h"
+
+/* sensors that haven't captured for this long go to soft sleep */
+#define POWER_IDLE_MS 500
+
+/*
+ * Sleep until the next interrupt unless cond is true. cond is checked
+ * with interrupts masked, one that makes it true in between still ends
+ * the WFI, so no wakeup is lost. The tick bounds every sleep to 1 ms.
+ */
+#define POWER_SLEEP_UNLESS(cond) \
+    do { \
+        uint32_t power_t = timer_cycles(); \
+        __disable_irq(); \
+        if (!(cond)) __WFI(); \
+        __enable_irq(); \
+        perf_sleep(timer_cycles() - power_t); \
+    } while (0)
+
+void power_idle(struct ov7670 *cams, uint8_t ncams, uint32_t next_ms);
+
+#endif
+
+/* vim: set et sw=4: */
@@ -0,0 +1,407 @@
+/*
+===============================================================================
+ Name        : proto.c
+ Author      : Upi Tamminen
+ Version     : 1.0
+ Copyright   : Upi Tamminen (2012)
+ Description : framed binary requests with a dispatch table
+===============================================================================
+*/
+
+#ifdef __USE_CMSIS
+#include "LPC17xx.h"
+#endif
+
+#include <cr_section_macros.h>
+
+#include <string.h>
+
+#include "proto.h"
+#include "ov7670.h"
+#include "stats.h"
+#include "stream.h"
+#include "uart0.h"
+#include "log.h"
+#include "boot.h"
+#include "perf.h"
+#include "timer.h"
+#include "pack.h"
+#include "type.h"
+
+struct proto_cmd {
+    uint8_t opcode;
+    uint8_t minlen, maxlen; /* of the request payload */
+    uint8_t (*handler)(const uint8_t *req, uint16_t len,
+            uint8_t *reply, uint16_t *replylen);
+};
+
+static struct ov7670 *proto_cams;
+static uint8_t proto_ncams;
+static struct ov7670 *proto_cam; /* selected with PROTO_CAM */
+static uint8_t proto_log_push; /* send log records when idle */
+
+/* receive state */
+static enum {
+    PROTO_IDLE,
+    PROTO_HEADER,
+    PROTO_PAYLOAD,
+    PROTO_CRC
+} proto_state;
+static uint8_t proto_hdr[PROTO_HEADER_SIZE];
+static uint8_t proto_req[PROTO_MAX_REQUEST];
+static uint16_t proto_pos, proto_len, proto_crc;
+
+static __BSS(RAM2) uint8_t proto_reply[PROTO_MAX_REPLY];
+
+static uint16_t proto_crc16(uint16_t crc, const uint8_t *p, uint32_t n)
+{
+    uint32_t i;
+
+    while (n--) {
+        crc ^= *p++ << 8;
+        for (i = 0; i < 8; i ++) {
+            crc = crc & 0x8000 ? (crc << 1) ^ 0x1021 : crc << 1;
+        }
+    }
+    return crc;
+}
+
+static void proto_send(uint8_t opcode, uint8_t id, uint8_t status,
+        const uint8_t *payload, uint16_t len)
+{
+    uint8_t hdr[PROTO_HEADER_SIZE], *p = hdr;
+    uint16_t crc, i;
+
+    *p++ = PROTO_SYNC;
+    *p++ = opcode;
+    *p++ = id;
+    *p++ = status;
+    pack16(p, len);
+    crc = proto_crc16(0xffff, hdr + 1, PROTO_HEADER_SIZE - 1);
+    crc = proto_crc16(crc, payload, len);
+
+    for (i = 0; i < PROTO_HEADER_SIZE; i ++) {
+        UART0_Sendchar(hdr[i]);
+    }
+    for (i = 0; i < len; i ++) {
+        UART0_Sendchar(payload[i]);
+    }
+    UART0_Sendchar(crc);
+    UART0_Sendchar(crc >> 8);
+}
+
+static uint8_t proto_ping(const uint8_t *req, uint16_t len,
+        uint8_t *reply, uint16_t *replylen)
+{
+    memcpy(reply, req, len);
+    *replylen = len;
+    return PROTO_OK;
+}
+
+static uint8_t proto_capture(const uint8_t *req, uint16_t len,
+        uint8_t *reply, uint16_t *replylen)
+{
+    reply[0] = ov7670_readframe(proto_cam);
+    if (reply[0] != OV7670_OK) {
+        *replylen = 1;
+        return PROTO_ERR_FAILED;
+    }
+    return PROTO_OK;
+}
+
+static uint8_t proto_info(const uint8_t *req, uint16_t len,
+        uint8_t *reply, uint16_t *replylen)
+{
+    *replylen = ov7670_pack_info(proto_cam, reply);
+    return PROTO_OK;
+}
+
+static uint8_t proto_linebytes(const uint8_t *req, uint16_t len,
+        uint8_t *reply, uint16_t *replylen)
+{
+    struct ov7670_frameinfo *info = &proto_cam->store->front->info;
+    uint8_t *p = reply;
+    uint32_t i;
+
+    for (i = 0; i < OV7670_MAX_LINES; i ++) {
+        p = pack16(p, info->linebytes[i]);
+    }
+    *replylen = p - reply;
+    return PROTO_OK;
+}
+
+static uint8_t proto_stats(const uint8_t *req, uint16_t len,
+        uint8_t *reply, uint16_t *replylen)
+{
+    struct ov7670_frame *f = proto_cam->store->front;
+
+    if (!f->stats.pixels) {
+        return PROTO_ERR_FAILED;
+    }
+    *replylen = stats_pack(&f->stats, reply);
+    return PROTO_OK;
+}
+
+static uint8_t proto_getline(const uint8_t *req, uint16_t len,
+        uint8_t *reply, uint16_t *replylen)
+{
+    struct ov7670_frame *f = proto_cam->store->front;
+    uint16_t y = req[0] | (req[1] << 8), x, w;
+    uint32_t n;
+    uint8_t *p = reply;
+
+    w = pixel_columns(f->format, f->width);
+    if (y >= f->height || w * 2 > PROTO_MAX_REPLY) {
+        return PROTO_ERR_FAILED;
+    }
+    n = y * w;
+    for (x = 0; x < w; x ++) {
+        *p++ = f->plane1[n + x];
+        if (f->plane2) {
+            *p++ = f->plane2[n + x];
+        }
+    }
+    *replylen = p - reply;
+    return PROTO_OK;
+}
+
+static uint8_t proto_select(const uint8_t *req, uint16_t len,
+        uint8_t *reply, uint16_t *replylen)
+{
+    if (req[0] >= proto_ncams) {
+        return PROTO_ERR_FAILED;
+    }
+    proto_cam = &proto_cams[req[0]];
+    return PROTO_OK;
+}
+
+static uint8_t proto_mode(const uint8_t *req, uint16_t len,
+        uint8_t *reply, uint16_t *replylen)
+{
+    const struct ov7670_mode *mode = proto_cam->mode;
+    uint16_t height = mode->height;
+    uint32_t w = pixel_columns(mode->format, mode->width);
+    uint8_t *p = reply;
+
+    /* what fits in the frame store */
+    if (w * height > proto_cam->store->size) {
+        height = proto_cam->store->size / w;
+    }
+    p = pack16(p, mode->width);
+    p = pack16(p, height);
+    *p++ = mode->format;
+    len = strlen(mode->name);
+    memcpy(p, mode->name, len);
+    *replylen = p + len - reply;
+    return PROTO_OK;
+}
+
+static uint8_t proto_set_mode(const uint8_t *req, uint16_t len,
+        uint8_t *reply, uint16_t *replylen)
+{
+    const struct ov7670_mode *mode;
+    char name[PROTO_MAX_REQUEST + 1];
+
+    memcpy(name, req, len);
+    name[len] = 0;
+    mode = ov7670_find_mode(name);
+    if (!mode || !ov7670_set_mode(proto_cam, mode)) {
+        return PROTO_ERR_FAILED;
+    }
+    return PROTO_OK;
+}
+
+static uint8_t proto_reg_read(const uint8_t *req, uint16_t len,
+        uint8_t *reply, uint16_t *replylen)
+{
+    if (ov7670_get(proto_cam, req[0], &reply[0]) != I2CSTATE_ACK) {
+        return PROTO_ERR_FAILED;
+    }
+    *replylen = 1;
+    return PROTO_OK;
+}
+
+static uint8_t proto_reg_write(const uint8_t *req, uint16_t len,
+        uint8_t *reply, uint16_t *replylen)
+{
+    ov7670_set(proto_cam, req[0], req[1]);
+    return PROTO_OK;
+}
+
+static uint8_t proto_stream(const uint8_t *req, uint16_t len,
+        uint8_t *reply, uint16_t *replylen)
+{
+    if (req[2] == 0) {
+        stream_stop();
+        return PROTO_OK;
+    }
+    if (!stream_start(proto_cams, proto_ncams, req[0] | (req[1] << 8),
+                req[2])) {
+        return PROTO_ERR_FAILED;
+    }
+    return PROTO_OK;
+}
+
+static uint8_t proto_log(const uint8_t *req, uint16_t len,
+        uint8_t *reply, uint16_t *replylen)
+{
+    if (len) {
+        proto_log_push = req[0];
+    }
+    *replylen = log_read(reply, PROTO_MAX_REPLY);
+    return PROTO_OK;
+}
+
+static uint8_t proto_boot(const uint8_t *req, uint16_t len,
+        uint8_t *reply, uint16_t *replylen)
+{
+    uint8_t *p = reply, i;
+
+    for (i = 0; i < BOOT_NUM; i ++) {
+        p = pack32(p, boot_us(i));
+    }
+    *replylen = p - reply;
+    return PROTO_OK;
+}
+
+/* snapshot first, then the optional reset */
+static uint8_t proto_perf(const uint8_t *req, uint16_t len,
+        uint8_t *reply, uint16_t *replylen)
+{
+    *replylen = perf_pack(reply);
+    if (len && req[0]) {
+        perf_reset();
+    }
+    return PROTO_OK;
+}
+
+static const struct proto_cmd proto_cmds[] = {
+    { PROTO_PING, 0, PROTO_MAX_REQUEST, proto_ping },
+    { PROTO_CAPTURE, 0, 0, proto_capture },
+    { PROTO_INFO, 0, 0, proto_info },
+    { PROTO_LINEBYTES, 0, 0, proto_linebytes },
+    { PROTO_STATS, 0, 0, proto_stats },
+    { PROTO_GETLINE, 2, 2, proto_getline },
+    { PROTO_CAM, 1, 1, proto_select },
+    { PROTO_MODE, 0, 0, proto_mode },
+    { PROTO_SET_MODE, 1, PROTO_MAX_REQUEST, proto_set_mode },
+    { PROTO_REG_READ, 1, 1, proto_reg_read },
+    { PROTO_REG_WRITE, 2, 2, proto_reg_write },
+    { PROTO_STREAM, 3, 3, proto_stream },
+    { PROTO_LOG, 0, 1, proto_log },
+    { PROTO_BOOT, 0, 0, proto_boot },
+    { PROTO_PERF, 0, 1, proto_perf },
+};
+
+#define PROTO_NUM_CMDS (sizeof(proto_cmds) / sizeof(proto_cmds[0]))
+
+static void proto_dispatch(uint8_t opcode, uint8_t id,
+        const uint8_t *req, uint16_t len)
+{
+    const struct proto_cmd *cmd = NULL;
+    uint16_t replylen = 0;
+    uint8_t status;
+    uint32_t i, t = timer_cycles();
+
+    for (i = 0; i < PROTO_NUM_CMDS; i ++) {
+        if (proto_cmds[i].opcode == opcode) {
+            cmd = &proto_cmds[i];
+            break;
+        }
+    }
+
+    if (!cmd) {
+        status = PROTO_ERR_OPCODE;
+    } else if (len < cmd->minlen || len > cmd->maxlen) {
+        status = PROTO_ERR_LENGTH;
+    } else {
+        status = cmd->handler(req, len, proto_reply, &replylen);
+    }
+    proto_send(opcode, id, status, proto_reply, replylen);
+    perf_command(t);
+}
+
+void proto_init(struct ov7670 *cams, uint8_t ncams)
+{
+    proto_cams = cams;
+    proto_ncams = ncams;
+    proto_cam = &cams[0];
+}
+
+/* whatever fits of the log as a PROTO_LOG reply */
+void proto_send_log(uint8_t id)
+{
+    proto_send(PROTO_LOG, id, PROTO_OK, proto_reply,
+            log_read(proto_reply, PROTO_MAX_REPLY));
+}
+
+/*
+ * Call when nothing has been received, pushes the log to the host if it
+ * asked for that and nothing else is going on.
+ */
+void proto_idle(void)
+{
+    if (proto_log_push && proto_state == PROTO_IDLE && !stream_active() &&
+            log_pending()) {
+        proto_send_log(0);
+    }
+}
+
+/*
+ * Feed a received byte, returns 0 if it isn't part of a binary request
+ * and should go to the text command parser. Complete requests are
+ * handled right away.
+ */
+uint32_t proto_feed(uint8_t c)
+{
+    switch (proto_state) {
+    case PROTO_IDLE:
+        if (c != PROTO_SYNC) {
+            return 0;
+        }
+        proto_hdr[0] = c;
+        proto_pos = 1;
+        proto_state = PROTO_HEADER;
+        break;
+    case PROTO_HEADER:
+        proto_hdr[proto_pos++] = c;
+        if (proto_pos < PROTO_HEADER_SIZE) {
+            break;
+        }
+        proto_len = proto_hdr[4] | (proto_hdr[5] << 8);
+        if (proto_len > PROTO_MAX_REQUEST) {
+            /* can't be one of ours, look for the next sync byte */
+            proto_send(proto_hdr[1], proto_hdr[2], PROTO_ERR_LENGTH,
+                    NULL, 0);
+            proto_state = PROTO_IDLE;
+            break;
+        }
+        proto_pos = 0;
+        proto_state = proto_len ? PROTO_PAYLOAD : PROTO_CRC;
+        break;
+    case PROTO_PAYLOAD:
+        proto_req[proto_pos++] = c;
+        if (proto_pos == proto_len) {
+            proto_pos = 0;
+            proto_state = PROTO_CRC;
+        }
+        break;
+    case PROTO_CRC:
+        if (proto_pos++ == 0) {
+            proto_crc = c;
+            break;
+        }
+        proto_crc |= c << 8;
+        proto_state = PROTO_IDLE;
+        if (proto_crc != proto_crc16(proto_crc16(0xffff, proto_hdr + 1,
+                        PROTO_HEADER_SIZE - 1), proto_req, proto_len)) {
+            proto_send(proto_hdr[1], proto_hdr[2], PROTO_ERR_CRC, NULL, 0);
+            break;
+        }
+        proto_dispatch(proto_hdr[1], proto_hdr[2], proto_req, proto_len);
+        break;
+    }
+    return 1;
+}
+
+/* vim: set et sw=4: */
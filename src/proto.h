@@ -0,0 +1,52 @@
+#ifndef __PROTO_H
+#define __PROTO_H
+
+#include "type.h"
+#include "ov7670.h"
+
+/*
+ * Binary requests, alongside the text commands. Every message is
+ *
+ *   sync (0xa5), opcode (u8), request id (u8), status (u8),
+ *   payload length (u16), payload, crc16 (u16)
+ *
+ * little endian, crc16-ccitt over everything after the sync byte. Replies
+ * echo the opcode and request id, requests have status 0. Failed replies
+ * are empty unless noted below. Requests are answered in order, the host
+ * may send several without waiting.
+ */
+#define PROTO_SYNC 0xa5
+#define PROTO_HEADER_SIZE 6
+#define PROTO_MAX_REQUEST 32
+#define PROTO_MAX_REPLY 640 /* a qvga rgb565 line */
+
+#define PROTO_PING      0x01 /* payload is echoed */
+#define PROTO_CAPTURE   0x02 /* fails with OV7670_ERR_ (u8) */
+#define PROTO_INFO      0x03 /* see ov7670_pack_info() */
+#define PROTO_LINEBYTES 0x04 /* u16 per line */
+#define PROTO_STATS     0x05 /* see stats_pack() */
+#define PROTO_GETLINE   0x06 /* line (u16) */
+#define PROTO_CAM       0x07 /* camera (u8) */
+#define PROTO_MODE      0x08 /* width, height (u16), format (u8), name */
+#define PROTO_SET_MODE  0x09 /* name */
+#define PROTO_REG_READ  0x0a /* register (u8), replies with the value */
+#define PROTO_REG_WRITE 0x0b /* register, value (u8) */
+#define PROTO_STREAM    0x0c /* fps (u16), stream format (u8), 0 = off */
+#define PROTO_LOG       0x0d /* [push when idle (u8)], see log.h */
+#define PROTO_BOOT      0x0e /* us to each checkpoint (u32), see boot.h */
+#define PROTO_PERF      0x0f /* [reset (u8)], see perf_pack() */
+
+#define PROTO_OK         0
+#define PROTO_ERR_CRC    1
+#define PROTO_ERR_OPCODE 2
+#define PROTO_ERR_LENGTH 3
+#define PROTO_ERR_FAILED 4
+
+void proto_init(struct ov7670 *cams, uint8_t ncams);
+uint32_t proto_feed(uint8_t c);
+void proto_send_log(uint8_t id);
+void proto_idle(void);
+
+#endif
+
+/* vim: set et sw=4: */
@@ -0,0 +1,160 @@
+/*
+===============================================================================
+ Name        : quant.c
+ Author      : Upi Tamminen
+ Version     : 1.0
+ Copyright   : Upi Tamminen (2012)
+ Description : rgb332 and palette quantization of rgb565 frames
+===============================================================================
+*/
+
+#include "quant.h"
+#include "pixel.h"
+#include "type.h"
+
+#define QUANT_R_LEVELS 8
+#define QUANT_G_LEVELS 8
+#define QUANT_B_LEVELS 4
+#define QUANT_MAX_LEVELS 8
+
+/* channel value to its bits of the index, like the blob class tables */
+static uint8_t quant_r[32], quant_g[64], quant_b[32];
+
+/* level back to a channel value in rgb565 units, for the palette */
+static uint8_t quant_rv[QUANT_R_LEVELS], quant_gv[QUANT_G_LEVELS],
+               quant_bv[QUANT_B_LEVELS];
+
+static uint32_t quant_hist_r[32], quant_hist_g[64], quant_hist_b[32];
+
+static uint8_t quant_row[QUANT_MAX_WIDTH];
+
+uint32_t quant_size(uint8_t format, uint16_t width, uint16_t height)
+{
+    if (format != FMT_RGB565 || width > QUANT_MAX_WIDTH) {
+        return 0;
+    }
+    return width * height;
+}
+
+/* levels rounded to the nearest, values spread over the whole range */
+static void quant_even(uint32_t bins, uint32_t levels, uint32_t shift,
+        uint8_t *map, uint8_t *value)
+{
+    uint32_t i;
+
+    for (i = 0; i < bins; i ++) {
+        map[i] = ((i * (levels - 1) * 2 + bins - 1) /
+                ((bins - 1) * 2)) << shift;
+    }
+    for (i = 0; i < levels; i ++) {
+        value[i] = (i * (bins - 1) * 2 + levels - 1) / ((levels - 1) * 2);
+    }
+}
+
+void quant_uniform(void)
+{
+    quant_even(32, QUANT_R_LEVELS, 5, quant_r, quant_rv);
+    quant_even(64, QUANT_G_LEVELS, 2, quant_g, quant_gv);
+    quant_even(32, QUANT_B_LEVELS, 0, quant_b, quant_bv);
+}
+
+/*
+ * Each bin goes to the level the middle of its share of the population
+ * falls in, which keeps the mapping monotonic. A level's value is the mean
+ * of the pixels in it. Levels nothing maps to are left at 0.
+ */
+static void quant_split(const uint32_t *hist, uint32_t bins, uint32_t total,
+        uint32_t levels, uint32_t shift, uint8_t *map, uint8_t *value)
+{
+    uint32_t sum[QUANT_MAX_LEVELS], count[QUANT_MAX_LEVELS];
+    uint32_t i, l, cum = 0;
+
+    for (l = 0; l < levels; l ++) {
+        sum[l] = count[l] = 0;
+    }
+    for (i = 0; i < bins; i ++) {
+        l = total ? (cum + hist[i] / 2) * levels / total : 0;
+        if (l >= levels) {
+            l = levels - 1;
+        }
+        map[i] = l << shift;
+        sum[l] += hist[i] * i;
+        count[l] += hist[i];
+        cum += hist[i];
+    }
+    for (l = 0; l < levels; l ++) {
+        value[l] = count[l] ? (sum[l] + count[l] / 2) / count[l] : 0;
+    }
+}
+
+void quant_adapt(const uint8_t *plane1, const uint8_t *plane2,
+        uint32_t pixels)
+{
+    uint32_t i;
+    uint8_t hi, lo;
+
+    for (i = 0; i < 32; i ++) {
+        quant_hist_r[i] = quant_hist_b[i] = 0;
+    }
+    for (i = 0; i < 64; i ++) {
+        quant_hist_g[i] = 0;
+    }
+    for (i = 0; i < pixels; i ++) {
+        hi = plane1[i];
+        lo = plane2[i];
+        quant_hist_r[rgb565_r(hi, lo)] ++;
+        quant_hist_g[rgb565_g(hi, lo)] ++;
+        quant_hist_b[rgb565_b(hi, lo)] ++;
+    }
+
+    quant_split(quant_hist_r, 32, pixels, QUANT_R_LEVELS, 5,
+            quant_r, quant_rv);
+    quant_split(quant_hist_g, 64, pixels, QUANT_G_LEVELS, 2,
+            quant_g, quant_gv);
+    quant_split(quant_hist_b, 32, pixels, QUANT_B_LEVELS, 0,
+            quant_b, quant_bv);
+}
+
+void quant_palette(void (*emit)(const uint8_t *row, uint16_t bytes))
+{
+    uint32_t r, g, b;
+    uint8_t *p;
+
+    for (r = 0; r < QUANT_R_LEVELS; r ++) {
+        p = quant_row;
+        for (g = 0; g < QUANT_G_LEVELS; g ++) {
+            for (b = 0; b < QUANT_B_LEVELS; b ++) {
+                *p++ = (quant_rv[r] << 3) | (quant_gv[g] >> 3);
+                *p++ = ((quant_gv[g] & 0x07) << 5) | quant_bv[b];
+            }
+        }
+        emit(quant_row, p - quant_row);
+    }
+}
+
+uint32_t quant_encode(const uint8_t *plane1, const uint8_t *plane2,
+        uint8_t format, uint16_t width, uint16_t height,
+        void (*emit)(const uint8_t *row, uint16_t bytes))
+{
+    uint32_t x, y;
+    uint8_t hi, lo;
+
+    if (!quant_size(format, width, height)) {
+        return 0;
+    }
+
+    for (y = 0; y < height; y ++) {
+        for (x = 0; x < width; x ++) {
+            hi = plane1[x];
+            lo = plane2[x];
+            quant_row[x] = quant_r[rgb565_r(hi, lo)] |
+                quant_g[rgb565_g(hi, lo)] | quant_b[rgb565_b(hi, lo)];
+        }
+        emit(quant_row, width);
+        plane1 += width;
+        plane2 += width;
+    }
+    return 1;
+}
+
+/* vim: set et sw=4: */
@@ -0,0 +1,43 @@
+#ifndef __QUANT_H
+#define __QUANT_H
+
+#include "type.h"
+
+#define QUANT_MAX_WIDTH 320
+
+/* 256 rgb565 entries in index order, sent ahead of palette frames */
+#define QUANT_PALETTE_SIZE 512
+
+/*
+ * Both formats pack a pixel into rrrgggbb. rgb332 uses evenly spaced
+ * levels, a palette frame uses levels fitted to the frame and the index
+ * is looked up in the palette sent with it.
+ */
+
+/* size of the indices for a frame, 0 if it can't be made */
+uint32_t quant_size(uint8_t format, uint16_t width, uint16_t height);
+
+/* evenly spaced rgb332 levels */
+void quant_uniform(void);
+
+/*
+ * Levels of roughly equal population from the histogram of each channel,
+ * so most of the 256 entries go to the colours the frame actually has.
+ */
+void quant_adapt(const uint8_t *plane1, const uint8_t *plane2,
+        uint32_t pixels);
+
+/* the palette for the current levels, in rows of 32 entries */
+void quant_palette(void (*emit)(const uint8_t *row, uint16_t bytes));
+
+/*
+ * One index per pixel with the current levels, three table lookups each.
+ * Each row is handed to emit() as soon as it's done.
+ */
+uint32_t quant_encode(const uint8_t *plane1, const uint8_t *plane2,
+        uint8_t format, uint16_t width, uint16_t height,
+        void (*emit)(const uint8_t *row, uint16_t bytes));
+
+#endif
+
+/* vim: set et sw=4: */
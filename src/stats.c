@@ -0,0 +1,97 @@
+/*
+===============================================================================
+ Name        : stats.c
+ Author      : Upi Tamminen
+ Version     : 1.0
+ Copyright   : Upi Tamminen (2012)
+ Description : frame statistics (luma histogram, channel sums, min/max)
+===============================================================================
+*/
+
+#include "stats.h"
+#include "pack.h"
+#include "pixel.h"
+#include "type.h"
+
+/* hi and lo are the first and second rgb565 bytes, as captured */
+void stats_compute(struct frame_stats *st,
+        const uint8_t *hi, const uint8_t *lo, uint32_t pixels)
+{
+    uint32_t i, sum_r = 0, sum_g = 0, sum_b = 0;
+    uint32_t r, g, b, y;
+    uint8_t min_r = 31, max_r = 0, min_g = 63, max_g = 0;
+    uint8_t min_b = 31, max_b = 0;
+    uint32_t clip_lo = 0, clip_hi = 0;
+
+    for (i = 0; i < STATS_HIST_BINS; i ++) {
+        st->hist[i] = 0;
+    }
+
+    for (i = 0; i < pixels; i ++) {
+        r = rgb565_r(hi[i], lo[i]);
+        g = rgb565_g(hi[i], lo[i]);
+        b = rgb565_b(hi[i], lo[i]);
+
+        sum_r += r;
+        sum_g += g;
+        sum_b += b;
+
+        if (r < min_r) min_r = r;
+        if (r > max_r) max_r = r;
+        if (g < min_g) min_g = g;
+        if (g > max_g) max_g = g;
+        if (b < min_b) min_b = b;
+        if (b > max_b) max_b = b;
+
+        if ((r | g | b) == 0) {
+            clip_lo ++;
+        } else if (r == 31 || g == 63 || b == 31) {
+            clip_hi ++;
+        }
+
+        y = rgb565_luma(r, g, b);
+        st->hist[y >> 4] ++;
+    }
+
+    st->pixels = pixels;
+    st->sum_r = sum_r;
+    st->sum_g = sum_g;
+    st->sum_b = sum_b;
+    st->min_r = min_r;
+    st->max_r = max_r;
+    st->min_g = min_g;
+    st->max_g = max_g;
+    st->min_b = min_b;
+    st->max_b = max_b;
+    st->clip_lo = clip_lo;
+    st->clip_hi = clip_hi;
+}
+
+#define STATS_SAT16(n) ((n) > 0xffff ? 0xffff : (n))
+
+/* little endian, STATS_PACKED_SIZE bytes */
+uint32_t stats_pack(const struct frame_stats *st, uint8_t *buf)
+{
+    uint8_t *p = buf;
+    uint32_t i;
+
+    p = pack32(p, st->pixels);
+    for (i = 0; i < STATS_HIST_BINS; i ++) {
+        p = pack16(p, STATS_SAT16(st->hist[i]));
+    }
+    p = pack32(p, st->sum_r);
+    p = pack32(p, st->sum_g);
+    p = pack32(p, st->sum_b);
+    *p++ = st->min_r;
+    *p++ = st->max_r;
+    *p++ = st->min_g;
+    *p++ = st->max_g;
+    *p++ = st->min_b;
+    *p++ = st->max_b;
+    p = pack16(p, STATS_SAT16(st->clip_lo));
+    p = pack16(p, STATS_SAT16(st->clip_hi));
+
+    return p - buf;
+}
+
+/* vim: set et sw=4: */
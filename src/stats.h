@@ -0,0 +1,30 @@
+#ifndef __STATS_H
+#define __STATS_H
+
+#include "type.h"
+
+#define STATS_HIST_BINS 16
+
+/* size of the packed stats block sent to the host */
+#define STATS_PACKED_SIZE (4 + STATS_HIST_BINS * 2 + 3 * 4 + 6 + 2 * 2)
+
+/*
+ * Channel values are in native rgb565 units (r & b 0..31, g 0..63). The
+ * counts are packed as u16 and saturate at 0xffff there.
+ */
+struct frame_stats {
+    uint32_t pixels;
+    uint32_t hist[STATS_HIST_BINS]; /* luma histogram, 16 levels per bin */
+    uint32_t sum_r, sum_g, sum_b;
+    uint8_t min_r, max_r, min_g, max_g, min_b, max_b;
+    uint32_t clip_lo; /* all channels at zero */
+    uint32_t clip_hi; /* any channel saturated */
+};
+
+void stats_compute(struct frame_stats *st,
+        const uint8_t *hi, const uint8_t *lo, uint32_t pixels);
+uint32_t stats_pack(const struct frame_stats *st, uint8_t *buf);
+
+#endif
+
+/* vim: set et sw=4: */
@@ -0,0 +1,363 @@
+/*
+===============================================================================
+ Name        : stream.c
+ Author      : Upi Tamminen
+ Version     : 1.0
+ Copyright   : Upi Tamminen (2012)
+ Description : continuous frame push to the host
+===============================================================================
+*/
+
+#ifdef __USE_CMSIS
+#include "LPC17xx.h"
+#endif
+
+#include <cr_section_macros.h>
+
+#include <string.h>
+
+#include "stream.h"
+#include "ov7670.h"
+#include "timer.h"
+#include "uart0.h"
+#include "pack.h"
+#include "thumb.h"
+#include "edge.h"
+#include "blob.h"
+#include "quant.h"
+#include "type.h"
+
+static const struct {
+    const char *name;
+    uint8_t format;
+} stream_formats[] = {
+    { "raw", STREAM_RAW },
+    { "thumb1", STREAM_THUMB1 },
+    { "thumb2", STREAM_THUMB2 },
+    { "thumb1-luma", STREAM_THUMB1_LUMA },
+    { "thumb2-luma", STREAM_THUMB2_LUMA },
+    { "edges", STREAM_EDGES },
+    { "blobs", STREAM_BLOBS },
+    { "rgb332", STREAM_RGB332 },
+    { "palette", STREAM_PALETTE },
+};
+
+/* what's in the thumbnail buffers of the store */
+static struct {
+    struct ov7670_frame *frame;
+    uint32_t seq;
+    uint8_t luma;
+    uint8_t format;
+    uint16_t width, height; /* of level 1 */
+} thumbs;
+
+static struct ov7670 *stream_cams;
+static uint8_t stream_ncams;
+static uint8_t stream_next_cam;
+
+static uint8_t stream_on = 0;
+static uint8_t stream_fmt;
+static uint32_t stream_interval; /* ms between frames, 0 = flat out */
+static uint32_t stream_next;
+
+/* returns 0 for unknown names */
+uint8_t stream_format(const char *name)
+{
+    uint32_t i;
+
+    for (i = 0; i < sizeof(stream_formats) / sizeof(stream_formats[0]); i ++) {
+        if (strcmp(name, stream_formats[i].name) == 0) {
+            return stream_formats[i].format;
+        }
+    }
+    return 0;
+}
+
+/* with several sensors the frames alternate between them */
+uint32_t stream_start(struct ov7670 *cams, uint8_t ncams,
+        uint32_t fps, uint8_t format)
+{
+    if (format == 0) {
+        return 0;
+    }
+
+    stream_cams = cams;
+    stream_ncams = ncams;
+    stream_next_cam = 0;
+    stream_fmt = format;
+    stream_interval = fps ? 1000 / fps : 0;
+    stream_next = timer_ms();
+    stream_on = 1;
+    return 1;
+}
+
+void stream_stop(void)
+{
+    stream_on = 0;
+}
+
+uint32_t stream_active(void)
+{
+    return stream_on;
+}
+
+/* ms until the next frame is due, 0 if it's due now or there's no pause
+ * between frames */
+uint32_t stream_wait(void)
+{
+    int32_t left;
+
+    if (!stream_on) {
+        return STREAM_NOTHING_DUE;
+    }
+    if (!stream_interval) {
+        return 0;
+    }
+    left = stream_next - timer_ms();
+    return left > 0 ? left : 0;
+}
+
+static void stream_send_header(struct ov7670 *cam, uint8_t format,
+        uint16_t width, uint16_t height, uint32_t length)
+{
+    struct ov7670_frame *f = cam->store->front;
+    uint8_t hdr[STREAM_HEADER_SIZE], *p = hdr;
+    uint32_t i;
+
+    memcpy(p, STREAM_MAGIC, 4);
+    p += 4;
+    p = pack32(p, f->info.seq);
+    p = pack32(p, f->info.timestamp);
+    *p++ = format;
+    *p++ = cam->id;
+    p = pack16(p, width);
+    p = pack16(p, height);
+    p = pack32(p, length);
+    p = pack16(p, f->info.skipped);
+
+    for (i = 0; i < STREAM_HEADER_SIZE; i ++) {
+        UART0_Sendchar(hdr[i]);
+    }
+}
+
+/*
+ * Single plane frames in ahb sram go out with DMA, so the next one can be
+ * captured into the other slot in the meantime.
+ */
+static void stream_send_frame(struct ov7670 *cam)
+{
+    struct ov7670_frame *f = cam->store->front;
+    uint32_t i, n = pixel_columns(f->format, f->width) * f->height;
+
+    if (!f->plane2 && UART0_CanDMA(f->plane1, n)) {
+        stream_send_header(cam, f->format, f->width, f->height, n);
+        UART0_SendDMA(f->plane1, n, &f->busy);
+        return;
+    }
+
+    stream_send_header(cam, f->format, f->width, f->height,
+            f->plane2 ? n * 2 : n);
+    for (i = 0; i < n; i ++) {
+        UART0_Sendchar(f->plane1[i]);
+        if (f->plane2) {
+            UART0_Sendchar(f->plane2[i]);
+        }
+    }
+}
+
+/* build both pyramid levels unless they already match the frame */
+static uint32_t stream_build_thumbs(struct ov7670_store *s, uint8_t luma)
+{
+    struct ov7670_frame *f = s->front;
+    uint8_t *thumb1 = s->thumb1, *thumb2 = s->thumb2;
+    uint16_t w = f->width / 2, h = f->height / 2;
+
+    /* yuv and luma frames only have luma at full resolution */
+    if (f->format == FMT_YUV422 || f->format == FMT_LUMA) {
+        luma = 1;
+    } else if (f->format != FMT_RGB565) {
+        return 0;
+    }
+    if (thumbs.frame == f && thumbs.seq == f->info.seq &&
+            thumbs.luma == luma) {
+        return 1;
+    }
+    if (!thumb1 || w * h * 2 > s->thumb_size) {
+        return 0;
+    }
+
+    if (f->format != FMT_RGB565) {
+        thumb_half_luma(f->plane1, f->width, f->height, thumb1);
+    } else if (luma) {
+        thumb_rgb565_luma(f->plane1, f->plane2, f->width, f->height, thumb1);
+    } else {
+        thumb_rgb565(f->plane1, f->plane2, f->width, f->height, thumb1);
+    }
+    if (luma) {
+        thumb_half_luma(thumb1, w, h, thumb2);
+    } else {
+        thumb_half_rgb565(thumb1, w, h, thumb2);
+    }
+
+    thumbs.frame = f;
+    thumbs.seq = f->info.seq;
+    thumbs.luma = luma;
+    thumbs.format = luma ? FMT_LUMA : FMT_RGB565;
+    thumbs.width = w;
+    thumbs.height = h;
+    return 1;
+}
+
+/*
+ * Send level 1 (half size) or 2 (quarter size) of the frame in the store
+ * with the stream header. rgb565 frames can be sent as luma.
+ */
+uint32_t stream_send_thumb(struct ov7670 *cam, uint8_t level, uint8_t luma)
+{
+    uint8_t *buf = level == 1 ? cam->store->thumb1 : cam->store->thumb2;
+    uint32_t i, n;
+    uint16_t w, h;
+
+    if ((level != 1 && level != 2) || !stream_build_thumbs(cam->store, luma)) {
+        return 0;
+    }
+
+    w = thumbs.width >> (level - 1);
+    h = thumbs.height >> (level - 1);
+    n = w * h * (thumbs.format == FMT_LUMA ? 1 : 2);
+
+    stream_send_header(cam, thumbs.format, w, h, n);
+    for (i = 0; i < n; i ++) {
+        UART0_Sendchar(buf[i]);
+    }
+    return 1;
+}
+
+static void stream_send_row(const uint8_t *row, uint16_t bytes)
+{
+    while (bytes--) {
+        UART0_Sendchar(*row++);
+    }
+}
+
+/* sobel edge map of the frame in the store, sent as it's computed */
+uint32_t stream_send_edges(struct ov7670 *cam, uint16_t threshold)
+{
+    struct ov7670_frame *f = cam->store->front;
+    uint32_t n = edge_size(f->format, f->width, f->height);
+
+    if (!n) {
+        return 0;
+    }
+    stream_send_header(cam, FMT_EDGES, f->width, f->height, n);
+    edge_sobel(f->plane1, f->plane2, f->format, f->width, f->height,
+            threshold, stream_send_row);
+    return 1;
+}
+
+/*
+ * Blobs of the configured colours in the frame in the store, largest first.
+ * The header keeps the frame size, the payload is BLOB_PACKED_SIZE per blob.
+ */
+uint32_t stream_send_blobs(struct ov7670 *cam, uint32_t min_area)
+{
+    static struct blob_result res[BLOB_MAX_RESULTS];
+    struct ov7670_frame *f = cam->store->front;
+    uint8_t buf[BLOB_PACKED_SIZE];
+    uint32_t i, n;
+
+    if (f->format != FMT_RGB565) {
+        return 0;
+    }
+    n = blob_find(f->plane1, f->plane2, f->width, f->height, min_area,
+            res, BLOB_MAX_RESULTS);
+
+    stream_send_header(cam, FMT_BLOBS, f->width, f->height,
+            n * BLOB_PACKED_SIZE);
+    for (i = 0; i < n; i ++) {
+        blob_pack(&res[i], 1, buf);
+        stream_send_row(buf, BLOB_PACKED_SIZE);
+    }
+    return 1;
+}
+
+/*
+ * rgb565 frame in the store at one byte per pixel, as rgb332 or as indices
+ * into a palette fitted to the frame and sent ahead of them.
+ */
+uint32_t stream_send_quant(struct ov7670 *cam, uint8_t palette)
+{
+    struct ov7670_frame *f = cam->store->front;
+    uint32_t n = quant_size(f->format, f->width, f->height);
+
+    if (!n) {
+        return 0;
+    }
+    if (palette) {
+        quant_adapt(f->plane1, f->plane2, n);
+        stream_send_header(cam, FMT_PALETTE, f->width, f->height,
+                QUANT_PALETTE_SIZE + n);
+        quant_palette(stream_send_row);
+    } else {
+        quant_uniform();
+        stream_send_header(cam, FMT_RGB332, f->width, f->height, n);
+    }
+    return quant_encode(f->plane1, f->plane2, f->format, f->width,
+            f->height, stream_send_row);
+}
+
+/* call from the main loop, captures and sends a frame when one is due */
+void stream_poll(void)
+{
+    struct ov7670 *cam;
+    uint32_t now;
+
+    if (!stream_on) {
+        return;
+    }
+    if (stream_interval) {
+        now = timer_ms();
+        if ((int32_t) (now - stream_next) < 0) {
+            return;
+        }
+        stream_next += stream_interval;
+        /* fell behind, don't try to catch up with a burst */
+        if ((int32_t) (now - stream_next) >= 0) {
+            stream_next = now + stream_interval;
+        }
+    }
+
+    cam = &stream_cams[stream_next_cam];
+    stream_next_cam = (stream_next_cam + 1) % stream_ncams;
+
+    /* nothing to send, the next poll tries again */
+    if (ov7670_readframe(cam) != OV7670_OK) {
+        return;
+    }
+
+    switch (stream_fmt) {
+    case STREAM_THUMB1:
+    case STREAM_THUMB2:
+        stream_send_thumb(cam, stream_fmt - STREAM_THUMB1 + 1, 0);
+        break;
+    case STREAM_THUMB1_LUMA:
+    case STREAM_THUMB2_LUMA:
+        stream_send_thumb(cam, stream_fmt - STREAM_THUMB1_LUMA + 1, 1);
+        break;
+    case STREAM_EDGES:
+        stream_send_edges(cam, EDGE_THRESHOLD);
+        break;
+    case STREAM_BLOBS:
+        stream_send_blobs(cam, BLOB_MIN_AREA);
+        break;
+    case STREAM_RGB332:
+    case STREAM_PALETTE:
+        stream_send_quant(cam, stream_fmt == STREAM_PALETTE);
+        break;
+    default:
+        stream_send_frame(cam);
+        break;
+    }
+}
+
+/* vim: set et sw=4: */
@@ -0,0 +1,44 @@
+#ifndef __STREAM_H
+#define __STREAM_H
+
+#include "type.h"
+#include "ov7670.h"
+
+/*
+ * Every streamed frame starts with this header, little endian:
+ * "OV76", seq (u32), timestamp (u32), format (u8), camera id (u8),
+ * width (u16), height (u16), payload length (u32), sensor frames
+ * skipped before it (u16)
+ */
+#define STREAM_MAGIC "OV76"
+#define STREAM_HEADER_SIZE 24
+
+/* what to send, the header carries the pixel format */
+#define STREAM_RAW 1 /* the frame as captured */
+#define STREAM_THUMB1 2 /* half size */
+#define STREAM_THUMB2 3 /* quarter size */
+#define STREAM_THUMB1_LUMA 4
+#define STREAM_THUMB2_LUMA 5
+#define STREAM_EDGES 6 /* 1 bit sobel edge map */
+#define STREAM_BLOBS 7 /* colour blobs, no pixels */
+#define STREAM_RGB332 8 /* 8 bit colour previews */
+#define STREAM_PALETTE 9
+
+/* stream_wait() when not streaming */
+#define STREAM_NOTHING_DUE 0xffffffff
+
+uint8_t stream_format(const char *name);
+uint32_t stream_start(struct ov7670 *cams, uint8_t ncams,
+        uint32_t fps, uint8_t format);
+void stream_stop(void);
+uint32_t stream_active(void);
+uint32_t stream_wait(void);
+void stream_poll(void);
+uint32_t stream_send_thumb(struct ov7670 *cam, uint8_t level, uint8_t luma);
+uint32_t stream_send_edges(struct ov7670 *cam, uint16_t threshold);
+uint32_t stream_send_blobs(struct ov7670 *cam, uint32_t min_area);
+uint32_t stream_send_quant(struct ov7670 *cam, uint8_t palette);
+
+#endif
+
+/* vim: set et sw=4: */
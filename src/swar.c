@@ -0,0 +1,224 @@
+/*
+===============================================================================
+ Name        : swar.c
+ Author      : Upi Tamminen
+ Version     : 1.0
+ Copyright   : Upi Tamminen (2012)
+ Description : pixel kernels, four pixels per register
+===============================================================================
+*/
+
+#include <string.h>
+
+#include "swar.h"
+#include "pixel.h"
+#include "type.h"
+
+#define SWAR_ONES 0x01010101
+#define SWAR_HIGH 0x80808080
+
+/* the m3 does unaligned word loads, gcc turns these into a single ldr/str */
+static inline uint32_t swar_load(const uint8_t *p)
+{
+    uint32_t w;
+
+    memcpy(&w, p, 4);
+    return w;
+}
+
+static inline void swar_store(uint8_t *p, uint32_t w)
+{
+    memcpy(p, &w, 4);
+}
+
+/* a - b in every byte, wrapping */
+static inline uint32_t swar_sub(uint32_t a, uint32_t b)
+{
+    return ((a | SWAR_HIGH) - (b & ~SWAR_HIGH)) ^ ((a ^ ~b) & SWAR_HIGH);
+}
+
+/* 0xff in every byte where a < b, from the borrow out of each byte */
+static inline uint32_t swar_lt(uint32_t a, uint32_t b)
+{
+    uint32_t borrow = ((~a & b) | ((~a | b) & swar_sub(a, b))) & SWAR_HIGH;
+
+    return (borrow >> 7) * 0xff;
+}
+
+void swar_luma_ref(const uint8_t *hi, const uint8_t *lo, uint32_t n,
+        uint8_t *out)
+{
+    uint32_t i;
+
+    for (i = 0; i < n; i ++) {
+        out[i] = rgb565_luma(rgb565_r(hi[i], lo[i]), rgb565_g(hi[i], lo[i]),
+                rgb565_b(hi[i], lo[i]));
+    }
+}
+
+/*
+ * Two pixels per word in 16 bit lanes, 31 * 616 + 63 * 600 + 31 * 232
+ * still fits in one so the products never carry into the next lane.
+ */
+void swar_luma(const uint8_t *hi, const uint8_t *lo, uint32_t n,
+        uint8_t *out)
+{
+    uint32_t i, h, l, r, g, b, even, odd;
+
+    for (i = 0; i + 4 <= n; i += 4) {
+        h = swar_load(hi + i);
+        l = swar_load(lo + i);
+        r = (h >> 3) & 0x1f1f1f1f;
+        g = ((h & 0x07070707) << 3) | ((l >> 5) & 0x07070707);
+        b = l & 0x1f1f1f1f;
+        even = (r & 0x00ff00ff) * 616 + (g & 0x00ff00ff) * 600 +
+            (b & 0x00ff00ff) * 232;
+        odd = ((r >> 8) & 0x00ff00ff) * 616 + ((g >> 8) & 0x00ff00ff) * 600 +
+            ((b >> 8) & 0x00ff00ff) * 232;
+        swar_store(out + i, ((even >> 8) & 0x00ff00ff) | (odd & 0xff00ff00));
+    }
+    swar_luma_ref(hi + i, lo + i, n - i, out + i);
+}
+
+void swar_channel_ref(const uint8_t *hi, const uint8_t *lo, uint32_t n,
+        uint8_t channel, uint8_t *out)
+{
+    uint32_t i;
+
+    for (i = 0; i < n; i ++) {
+        switch (channel) {
+        case SWAR_R:
+            out[i] = rgb565_r(hi[i], lo[i]);
+            break;
+        case SWAR_G:
+            out[i] = rgb565_g(hi[i], lo[i]);
+            break;
+        default:
+            out[i] = rgb565_b(hi[i], lo[i]);
+            break;
+        }
+    }
+}
+
+void swar_channel(const uint8_t *hi, const uint8_t *lo, uint32_t n,
+        uint8_t channel, uint8_t *out)
+{
+    uint32_t i, h, l, v;
+
+    for (i = 0; i + 4 <= n; i += 4) {
+        h = swar_load(hi + i);
+        l = swar_load(lo + i);
+        switch (channel) {
+        case SWAR_R:
+            v = (h >> 3) & 0x1f1f1f1f;
+            break;
+        case SWAR_G:
+            v = ((h & 0x07070707) << 3) | ((l >> 5) & 0x07070707);
+            break;
+        default:
+            v = l & 0x1f1f1f1f;
+            break;
+        }
+        swar_store(out + i, v);
+    }
+    swar_channel_ref(hi + i, lo + i, n - i, channel, out + i);
+}
+
+void swar_absdiff_ref(const uint8_t *a, const uint8_t *b, uint32_t n,
+        uint8_t *out)
+{
+    uint32_t i;
+
+    for (i = 0; i < n; i ++) {
+        out[i] = a[i] > b[i] ? a[i] - b[i] : b[i] - a[i];
+    }
+}
+
+/* negate the bytes that went below zero, ~d + 1 can't carry out of a
+ * byte since d isn't 0 there */
+void swar_absdiff(const uint8_t *a, const uint8_t *b, uint32_t n,
+        uint8_t *out)
+{
+    uint32_t i, x, y, m;
+
+    for (i = 0; i + 4 <= n; i += 4) {
+        x = swar_load(a + i);
+        y = swar_load(b + i);
+        m = swar_lt(x, y);
+        swar_store(out + i, (swar_sub(x, y) ^ m) + (m & SWAR_ONES));
+    }
+    swar_absdiff_ref(a + i, b + i, n - i, out + i);
+}
+
+void swar_threshold_ref(const uint8_t *in, uint32_t n, uint8_t threshold,
+        uint8_t *out)
+{
+    uint32_t i;
+
+    for (i = 0; i < n; i ++) {
+        out[i] = in[i] >= threshold ? 0xff : 0;
+    }
+}
+
+void swar_threshold(const uint8_t *in, uint32_t n, uint8_t threshold,
+        uint8_t *out)
+{
+    uint32_t i, t = threshold * SWAR_ONES;
+
+    for (i = 0; i + 4 <= n; i += 4) {
+        swar_store(out + i, ~swar_lt(swar_load(in + i), t));
+    }
+    swar_threshold_ref(in + i, n - i, threshold, out + i);
+}
+
+void swar_addsat_ref(const uint8_t *a, const uint8_t *b, uint32_t n,
+        uint8_t *out)
+{
+    uint32_t i, v;
+
+    for (i = 0; i < n; i ++) {
+        v = a[i] + b[i];
+        out[i] = v > 0xff ? 0xff : v;
+    }
+}
+
+/* add the low seven bits, fix up the top one and saturate on its carry */
+void swar_addsat(const uint8_t *a, const uint8_t *b, uint32_t n,
+        uint8_t *out)
+{
+    uint32_t i, x, y, s, carry;
+
+    for (i = 0; i + 4 <= n; i += 4) {
+        x = swar_load(a + i);
+        y = swar_load(b + i);
+        s = ((x & ~SWAR_HIGH) + (y & ~SWAR_HIGH)) ^ ((x ^ y) & SWAR_HIGH);
+        carry = ((x & y) | ((x | y) & ~s)) & SWAR_HIGH;
+        swar_store(out + i, s | ((carry >> 7) * 0xff));
+    }
+    swar_addsat_ref(a + i, b + i, n - i, out + i);
+}
+
+void swar_avg_ref(const uint8_t *a, const uint8_t *b, uint32_t n,
+        uint8_t *out)
+{
+    uint32_t i;
+
+    for (i = 0; i < n; i ++) {
+        out[i] = (a[i] + b[i] + 1) >> 1;
+    }
+}
+
+void swar_avg(const uint8_t *a, const uint8_t *b, uint32_t n,
+        uint8_t *out)
+{
+    uint32_t i, x, y;
+
+    for (i = 0; i + 4 <= n; i += 4) {
+        x = swar_load(a + i);
+        y = swar_load(b + i);
+        swar_store(out + i, (x | y) - (((x ^ y) >> 1) & 0x7f7f7f7f));
+    }
+    swar_avg_ref(a + i, b + i, n - i, out + i);
+}
+
+/* vim: set et sw=4: */
@@ -0,0 +1,58 @@
+#ifndef __SWAR_H
+#define __SWAR_H
+
+#include "type.h"
+
+/*
+ * Pixel kernels that work on four bytes (or two 16 bit lanes) per 32 bit
+ * word, there's no simd on the m3. They take planes as captured: rgb565
+ * as the hi & lo byte planes, everything else one byte per pixel. Any
+ * length and alignment, the last n % 4 pixels go through the scalar
+ * version.
+ *
+ * The _ref versions are the plain byte at a time ones, the swar ones
+ * must give exactly the same output (see utils/swarbench.c).
+ */
+
+/* 8 bit luma, same as rgb565_luma() */
+void swar_luma(const uint8_t *hi, const uint8_t *lo, uint32_t n,
+        uint8_t *out);
+void swar_luma_ref(const uint8_t *hi, const uint8_t *lo, uint32_t n,
+        uint8_t *out);
+
+/* one channel in native units, same as rgb565_r/g/b() */
+#define SWAR_R 0
+#define SWAR_G 1
+#define SWAR_B 2
+void swar_channel(const uint8_t *hi, const uint8_t *lo, uint32_t n,
+        uint8_t channel, uint8_t *out);
+void swar_channel_ref(const uint8_t *hi, const uint8_t *lo, uint32_t n,
+        uint8_t channel, uint8_t *out);
+
+/* |a - b| */
+void swar_absdiff(const uint8_t *a, const uint8_t *b, uint32_t n,
+        uint8_t *out);
+void swar_absdiff_ref(const uint8_t *a, const uint8_t *b, uint32_t n,
+        uint8_t *out);
+
+/* 0xff where in >= threshold, 0 elsewhere */
+void swar_threshold(const uint8_t *in, uint32_t n, uint8_t threshold,
+        uint8_t *out);
+void swar_threshold_ref(const uint8_t *in, uint32_t n, uint8_t threshold,
+        uint8_t *out);
+
+/* a + b, saturating at 255 */
+void swar_addsat(const uint8_t *a, const uint8_t *b, uint32_t n,
+        uint8_t *out);
+void swar_addsat_ref(const uint8_t *a, const uint8_t *b, uint32_t n,
+        uint8_t *out);
+
+/* (a + b + 1) / 2 */
+void swar_avg(const uint8_t *a, const uint8_t *b, uint32_t n,
+        uint8_t *out);
+void swar_avg_ref(const uint8_t *a, const uint8_t *b, uint32_t n,
+        uint8_t *out);
+
+#endif
+
+/* vim: set et sw=4: */
@@ -0,0 +1,106 @@
+/*
+===============================================================================
+ Name        : thumb.c
+ Author      : Upi Tamminen
+ Version     : 1.0
+ Copyright   : Upi Tamminen (2012)
+ Description : downscaled previews by box averaging
+===============================================================================
+*/
+
+#include "thumb.h"
+#include "pixel.h"
+#include "type.h"
+
+/* planar rgb565 frame to a half size interleaved rgb565 one */
+void thumb_rgb565(const uint8_t *hi, const uint8_t *lo,
+        uint16_t width, uint16_t height, uint8_t *out)
+{
+    uint32_t x, y, i, j, r, g, b;
+
+    for (y = 0; y < height / 2; y ++) {
+        i = y * 2 * width;
+        for (x = 0; x < width / 2; x ++, i += 2) {
+            j = i + width;
+            r = rgb565_r(hi[i], lo[i]) + rgb565_r(hi[i + 1], lo[i + 1]) +
+                rgb565_r(hi[j], lo[j]) + rgb565_r(hi[j + 1], lo[j + 1]);
+            g = rgb565_g(hi[i], lo[i]) + rgb565_g(hi[i + 1], lo[i + 1]) +
+                rgb565_g(hi[j], lo[j]) + rgb565_g(hi[j + 1], lo[j + 1]);
+            b = rgb565_b(hi[i], lo[i]) + rgb565_b(hi[i + 1], lo[i + 1]) +
+                rgb565_b(hi[j], lo[j]) + rgb565_b(hi[j + 1], lo[j + 1]);
+            r = (r + 2) >> 2;
+            g = (g + 2) >> 2;
+            b = (b + 2) >> 2;
+            *out++ = (r << 3) | (g >> 3);
+            *out++ = (g << 5) | b;
+        }
+    }
+}
+
+/* planar rgb565 frame to a half size 8 bit luma one */
+void thumb_rgb565_luma(const uint8_t *hi, const uint8_t *lo,
+        uint16_t width, uint16_t height, uint8_t *out)
+{
+    uint32_t x, y, i, j, k, sum;
+
+    for (y = 0; y < height / 2; y ++) {
+        i = y * 2 * width;
+        for (x = 0; x < width / 2; x ++, i += 2) {
+            j = i + width;
+            sum = 0;
+            for (k = 0; k < 2; k ++) {
+                sum += rgb565_luma(rgb565_r(hi[i + k], lo[i + k]),
+                        rgb565_g(hi[i + k], lo[i + k]),
+                        rgb565_b(hi[i + k], lo[i + k]));
+                sum += rgb565_luma(rgb565_r(hi[j + k], lo[j + k]),
+                        rgb565_g(hi[j + k], lo[j + k]),
+                        rgb565_b(hi[j + k], lo[j + k]));
+            }
+            *out++ = (sum + 2) >> 2;
+        }
+    }
+}
+
+/* interleaved rgb565 image to half size, for the next pyramid level */
+void thumb_half_rgb565(const uint8_t *in,
+        uint16_t width, uint16_t height, uint8_t *out)
+{
+    uint32_t x, y, r, g, b, k;
+    const uint8_t *p, *q;
+
+    for (y = 0; y < height / 2; y ++) {
+        p = in + y * 2 * width * 2;
+        q = p + width * 2;
+        for (x = 0; x < width / 2; x ++, p += 4, q += 4) {
+            r = g = b = 0;
+            for (k = 0; k < 4; k += 2) {
+                r += rgb565_r(p[k], p[k + 1]) + rgb565_r(q[k], q[k + 1]);
+                g += rgb565_g(p[k], p[k + 1]) + rgb565_g(q[k], q[k + 1]);
+                b += rgb565_b(p[k], p[k + 1]) + rgb565_b(q[k], q[k + 1]);
+            }
+            r = (r + 2) >> 2;
+            g = (g + 2) >> 2;
+            b = (b + 2) >> 2;
+            *out++ = (r << 3) | (g >> 3);
+            *out++ = (g << 5) | b;
+        }
+    }
+}
+
+/* 8 bit image to half size, also takes the y plane of a yuv422 frame */
+void thumb_half_luma(const uint8_t *in,
+        uint16_t width, uint16_t height, uint8_t *out)
+{
+    uint32_t x, y;
+    const uint8_t *p, *q;
+
+    for (y = 0; y < height / 2; y ++) {
+        p = in + y * 2 * width;
+        q = p + width;
+        for (x = 0; x < width / 2; x ++, p += 2, q += 2) {
+            *out++ = (p[0] + p[1] + q[0] + q[1] + 2) >> 2;
+        }
+    }
+}
+
+/* vim: set et sw=4: */
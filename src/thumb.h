@@ -0,0 +1,22 @@
+#ifndef __THUMB_H
+#define __THUMB_H
+
+#include "type.h"
+
+/*
+ * 2x2 box average downscaling. Odd trailing rows and columns are dropped,
+ * the output is (width / 2) x (height / 2). rgb565 output is interleaved,
+ * two bytes per pixel in the order they were captured.
+ */
+void thumb_rgb565(const uint8_t *hi, const uint8_t *lo,
+        uint16_t width, uint16_t height, uint8_t *out);
+void thumb_rgb565_luma(const uint8_t *hi, const uint8_t *lo,
+        uint16_t width, uint16_t height, uint8_t *out);
+void thumb_half_rgb565(const uint8_t *in,
+        uint16_t width, uint16_t height, uint8_t *out);
+void thumb_half_luma(const uint8_t *in,
+        uint16_t width, uint16_t height, uint8_t *out);
+
+#endif
+
+/* vim: set et sw=4: */
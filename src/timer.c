@@ -0,0 +1,52 @@
+/*
+===============================================================================
+ Name        : timer.c
+ Author      : Upi Tamminen
+ Version     : 1.0
+ Copyright   : Upi Tamminen (2012)
+ Description : millisecond tick from systick
+===============================================================================
+*/
+
+#ifdef __USE_CMSIS
+#include "LPC17xx.h"
+#endif
+
+#include "timer.h"
+#include "type.h"
+
+static volatile uint32_t timer_ticks = 0;
+
+void SysTick_Handler(void)
+{
+    timer_ticks ++;
+}
+
+void timer_init(void)
+{
+    SysTick_Config(SystemCoreClock / 1000);
+}
+
+/* milliseconds since timer_init(), wraps after ~49 days */
+uint32_t timer_ms(void)
+{
+    return timer_ticks;
+}
+
+/*
+ * cclk cycles since timer_init(), for differences only, it wraps every
+ * ~43 s. Unlike DWT->CYCCNT this keeps counting while the core sleeps.
+ * Needs interrupts enabled, the tick is read again if it moved meanwhile.
+ */
+uint32_t timer_cycles(void)
+{
+    uint32_t ms, val;
+
+    do {
+        ms = timer_ticks;
+        val = SysTick->VAL;
+    } while (ms != timer_ticks);
+    return ms * (SysTick->LOAD + 1) + SysTick->LOAD - val;
+}
+
+/* vim: set et sw=4: */
@@ -0,0 +1,12 @@
+#ifndef __TIMER_H
+#define __TIMER_H
+
+#include "type.h"
+
+void timer_init(void);
+uint32_t timer_ms(void);
+uint32_t timer_cycles(void);
+
+#endif
+
+/* vim: set et sw=4: */
@@ -29,8 +29,14 @@
 
 #include "LPC17xx.h"
 
+#include <cr_section_macros.h>
+
+#include "uart0.h"
+#include "perf.h"
+
 // PCUART0
 #define PCUART0_POWERON (1 << 3)
+#define PCGPDMA_POWERON (1 << 29)
 
 #define PCLK_UART0 6
 #define PCLK_UART0_MASK (3 << 6)
@@ -54,6 +60,32 @@
 #define LSR_TEMT	0x40
 #define LSR_RXFE	0x80
 
+#define FCR_DMA		0x08
+#define FCR_RX_TRIG8	0x80
+
+// GPDMA channel 0 feeds the UART0 TX fifo
+#define DMA_UART0_TX	8
+#define DMA_MAX_XFER	4095
+#define DMACC_SI	(1 << 26)
+#define DMACC_I		(1UL << 31)
+#define DMACC_E		(1 << 0)
+#define DMACC_M2P	(1 << 11)
+#define DMACC_IE	(1 << 14)
+#define DMACC_ITC	(1 << 15)
+
+struct dma_lli {
+    uint32_t src, dst, next, control;
+};
+
+// The GPDMA only reaches the ahb sram, the list has to live there too
+static __BSS(RAM2) struct dma_lli lli[UART0_DMA_LLIS];
+static volatile uint8_t *dma_lock;
+
+// Received bytes wait here, so requests sent back to back aren't lost
+// while a long command (a capture) runs
+static volatile uint8_t rx_buf[UART0_RX_SIZE];
+static volatile uint32_t rx_head, rx_tail;
+
 // ***********************
 // Function to set up UART
 void UART0_Init(int baudrate)
@@ -81,28 +113,155 @@ void UART0_Init(int baudrate)
     LPC_UART0->DLL = Fdiv % 256;
     /* 0x07 == 2 stop bits */
     LPC_UART0->LCR = 0x03;		// 8 bits, no Parity, 1 Stop bit DLAB = 0
-    LPC_UART0->FCR = 0x07;		// Enable and reset TX and RX FIFO
+    LPC_UART0->FCR = 0x07 | FCR_DMA | FCR_RX_TRIG8; // Enable and reset TX and RX FIFO
+    LPC_UART0->IER = IER_RBR | IER_RLS;	// Interrupt on received data & errors
+    NVIC_EnableIRQ(UART0_IRQn);
+
+    // Turn on the DMA controller for UART0_SendDMA()
+    LPC_SC->PCONP |= PCGPDMA_POWERON;
+    LPC_GPDMA->DMACConfig = 1;
+    NVIC_EnableIRQ(DMA_IRQn);
 }
 
 // ***********************
 // Function to send character over UART
 void UART0_Sendchar(char c)
 {
+    while (UART0_DMABusy());			// Keep the bytes in order
     while( (LPC_UART0->LSR & LSR_THRE) == 0 );	// Block until tx empty
 
     LPC_UART0->THR = c;
+    perf.tx_bytes ++;
 }
 
 // ***********************
 // Function to get character from UART
 char UART0_Getchar()
 {
-    char c;
-    while( (LPC_UART0->LSR & LSR_RDR) == 0 );  // Nothing received so just block 	
-    c = LPC_UART0->RBR; // Read Receiver buffer register
+    int c;
+    while ((c = UART0_Pollchar()) < 0)   // Nothing received so sleep, the
+        __WFI();                         // rx interrupt or the tick wakes us
+    return c;
+}
+
+// ***********************
+// Function to get character from UART without blocking,
+// returns -1 if nothing has been received
+int UART0_Pollchar()
+{
+    int c;
+
+    if (rx_tail == rx_head)
+        return -1;
+    c = rx_buf[rx_tail % UART0_RX_SIZE];
+    rx_tail ++;
     return c;
 }
 
+// ***********************
+// Function to check if anything has been received, without taking it
+int UART0_Available()
+{
+    return rx_tail != rx_head;
+}
+
+// ***********************
+// Receive interrupt, on the fifo trigger level, a character timeout or
+// a line error. Bytes that don't fit in the buffer are dropped.
+void UART0_IRQHandler(void)
+{
+    uint32_t lsr;
+
+    // reading LSR clears the error bits, so count them on every pass
+    while ((lsr = LPC_UART0->LSR) & (LSR_RDR | LSR_OE | LSR_FE)) {
+        if (lsr & LSR_OE) perf.uart_overrun ++;
+        if (lsr & LSR_FE) perf.uart_framing ++;
+        if (!(lsr & LSR_RDR)) continue;
+        if (rx_head - rx_tail < UART0_RX_SIZE) {
+            rx_buf[rx_head % UART0_RX_SIZE] = LPC_UART0->RBR;
+            rx_head ++;
+        } else {
+            (void) LPC_UART0->RBR;
+        }
+    }
+}
+
+// ***********************
+// Function to check if a buffer can be sent with UART0_SendDMA()
+int UART0_CanDMA(const uint8_t *buf, uint32_t len)
+{
+    uint32_t a = (uint32_t) buf;
+
+    return len && len <= UART0_DMA_MAX && a >= UART0_DMA_START &&
+        a + len <= UART0_DMA_END;
+}
+
+// ***********************
+// Function to send a buffer over UART in the background, *lock stays set
+// until DMA has read the last byte so the buffer can't be reused early.
+// Returns 0 without sending if UART0_CanDMA() says no.
+int UART0_SendDMA(const uint8_t *buf, uint32_t len, volatile uint8_t *lock)
+{
+    const uint8_t *start = buf;
+    uint32_t i, n;
+
+    if (!UART0_CanDMA(buf, len)) return 0;
+    while (UART0_DMABusy());
+    for (i = 0; len && i < UART0_DMA_LLIS; i ++) {
+        n = len > DMA_MAX_XFER ? DMA_MAX_XFER : len;
+        lli[i].src = (uint32_t) buf;
+        lli[i].dst = (uint32_t) &LPC_UART0->THR;
+        lli[i].next = 0;
+        lli[i].control = n | DMACC_SI; // byte wide, single transfers
+        if (i) lli[i - 1].next = (uint32_t) &lli[i];
+        buf += n;
+        len -= n;
+    }
+    lli[i - 1].control |= DMACC_I; // interrupt when the last one is done
+
+    *lock = 1;
+    dma_lock = lock;
+    perf.tx_bytes += buf - start;
+    LPC_GPDMA->DMACIntTCClear = 1;
+    LPC_GPDMA->DMACIntErrClr = 1;
+    LPC_GPDMACH0->DMACCSrcAddr = lli[0].src;
+    LPC_GPDMACH0->DMACCDestAddr = lli[0].dst;
+    LPC_GPDMACH0->DMACCLLI = lli[0].next;
+    LPC_GPDMACH0->DMACCControl = lli[0].control;
+    LPC_GPDMACH0->DMACCConfig = DMACC_E | (DMA_UART0_TX << 6) |
+        DMACC_M2P | DMACC_IE | DMACC_ITC;
+    return 1;
+}
+
+// ***********************
+// Function to check if a DMA send is still running
+int UART0_DMABusy()
+{
+    return LPC_GPDMA->DMACEnbldChns & 1;
+}
+
+// A bus error disables the channel, the buffer is released like at the
+// end of a send so nothing waits on it forever
+void DMA_IRQHandler(void)
+{
+    uint32_t done = 0;
+
+    if (LPC_GPDMA->DMACIntTCStat & 1) {
+        LPC_GPDMA->DMACIntTCClear = 1;
+        done = 1;
+    }
+    if (LPC_GPDMA->DMACIntErrStat & 1) {
+        LPC_GPDMA->DMACIntErrClr = 1;
+        done = 1;
+    }
+    if (done) {
+        if (dma_lock) {
+            *dma_lock = 0;
+            dma_lock = 0;
+        }
+    }
+}
+
 // ***********************
 // Function to prints the string out over the UART
 void UART0_PrintString(char *pcString)
@@ -29,6 +29,19 @@
 #ifndef UART_H_
 #define UART_H_
 
+#include "type.h"
+
+// Receive buffer, a power of two
+#define UART0_RX_SIZE 256
+
+// Longest DMA send is UART0_DMA_LLIS * 4095 bytes
+#define UART0_DMA_LLIS 8
+#define UART0_DMA_MAX (UART0_DMA_LLIS * 4095)
+
+// The GPDMA only reaches the ahb sram banks
+#define UART0_DMA_START 0x2007C000
+#define UART0_DMA_END   0x20084000
+
 // ***********************
 // Function to set up UART
 void UART0_Init(int baudrate);
@@ -41,6 +54,26 @@ void UART0_Sendchar(char c);
 // Function to get character from UART
 char UART0_Getchar();
 
+// ***********************
+// Function to get character from UART without blocking
+int UART0_Pollchar();
+
+// ***********************
+// Function to check if anything has been received
+int UART0_Available();
+
+// ***********************
+// Function to check if a buffer can be sent with UART0_SendDMA()
+int UART0_CanDMA(const uint8_t *buf, uint32_t len);
+
+// ***********************
+// Function to send a buffer over UART in the background
+int UART0_SendDMA(const uint8_t *buf, uint32_t len, volatile uint8_t *lock);
+
+// ***********************
+// Function to check if a DMA send is still running
+int UART0_DMABusy();
+
 // ***********************
 // Function to prints the string out over the UART
 void UART0_PrintString(char *pcString);
@@ -0,0 +1,49 @@
+/*
+===============================================================================
+ Name        : wdt.c
+ Author      : Upi Tamminen
+ Version     : 1.0
+ Copyright   : Upi Tamminen (2012)
+ Description : watchdog, resets the chip if the main loop stops
+===============================================================================
+*/
+
+#ifdef __USE_CMSIS
+#include "LPC17xx.h"
+#endif
+
+#include "wdt.h"
+#include "type.h"
+
+#define WDMOD_WDEN    (1 << 0)
+#define WDMOD_WDRESET (1 << 1)
+#define WDMOD_WDTOF   (1 << 2)
+
+/* the 4 MHz IRC, the watchdog counts it divided by 4 */
+#define WDT_TICKS_PER_MS 1000
+
+/*
+ * Start the watchdog, it can't be stopped again. Returns 1 if the last
+ * reset was caused by it.
+ */
+uint32_t wdt_init(uint32_t ms)
+{
+    uint32_t fired = (LPC_WDT->WDMOD & WDMOD_WDTOF) != 0;
+
+    LPC_WDT->WDCLKSEL = 0; /* irc */
+    LPC_WDT->WDTC = ms * WDT_TICKS_PER_MS;
+    LPC_WDT->WDMOD = WDMOD_WDEN | WDMOD_WDRESET;
+    wdt_feed();
+    return fired;
+}
+
+void wdt_feed(void)
+{
+    /* an interrupt between the two writes would abort the feed */
+    __disable_irq();
+    LPC_WDT->WDFEED = 0xaa;
+    LPC_WDT->WDFEED = 0x55;
+    __enable_irq();
+}
+
+/* vim: set et sw=4: */
@@ -0,0 +1,15 @@
+#ifndef __WDT_H
+#define __WDT_H
+
+#include "type.h"
+
+/* longer than the slowest thing the main loop does: a capture that times
+ * out a few times in a row followed by a sensor re-init */
+#define WDT_TIMEOUT_MS 4000
+
+uint32_t wdt_init(uint32_t ms);
+void wdt_feed(void);
+
+#endif
+
+/* vim: set et sw=4: */
@@ -0,0 +1,62 @@
+#
+# Expands the binary log records of the firmware, see log.h
+#
+# Record, little endian: id (u8), argument count (u8), device time in
+# ms (u32), arguments (u32 each)
+#
+
+import struct
+
+RECORD_HEADER_FORMAT = '<BBI'
+RECORD_HEADER_SIZE = struct.calcsize(RECORD_HEADER_FORMAT)
+
+I2C_STATES = {0x101: 'ack', 0x102: 'nack', 0x103: 'address nack',
+    0x104: 'arbitration lost', 0x105: 'timeout'}
+
+# OV7670_ERR_ in ov7670.h
+CAPTURE_ERRORS = {1: 'no vsync/href', 2: 'pixel clock stalled',
+    3: 'no sensor', 4: 'frame slot busy'}
+
+def i2cstate(state):
+    return I2C_STATES.get(state, '0x%x' % (state,))
+
+# keep in sync with the LOG_ ids in log.h
+FORMATS = {
+    0x00: lambda n: '%d log records dropped' % (n,),
+    0x01: lambda cclk: 'boot, cclk %d Hz' % (cclk,),
+    0x02: lambda: 'i2c init failed',
+    0x03: lambda cam: 'camera %d: initializing' % (cam,),
+    0x04: lambda cam, pid: 'camera %d: bad product id 0x%02x' % (cam, pid),
+    0x05: lambda cam: 'camera %d: ready' % (cam,),
+    0x06: lambda bus, reg, state: 'i2c%d: register 0x%02x, %s' %
+        (bus, reg, i2cstate(state)),
+    0x07: lambda state, master, slave: 'i2c %s, master %s, slave %s' %
+        (i2cstate(state), struct.pack('<I', master).encode('hex'),
+        struct.pack('<I', slave).encode('hex')),
+    0x08: lambda length: 'unknown text command (%d bytes)' % (length,),
+    0x09: lambda cam, err, lines: 'camera %d: capture failed, %s ' \
+        '(after %d lines)' % (cam, CAPTURE_ERRORS.get(err, err), lines),
+    0x0a: lambda cam: 'camera %d: resetting' % (cam,),
+    0x0b: lambda: 'reset by the watchdog',
+    }
+
+def parse(data):
+    """ list of (device time, message) """
+    records = []
+    pos = 0
+    while pos + RECORD_HEADER_SIZE <= len(data):
+        logid, nargs, timestamp = struct.unpack_from(RECORD_HEADER_FORMAT,
+            data, pos)
+        pos += RECORD_HEADER_SIZE
+        if pos + nargs * 4 > len(data):
+            break
+        args = struct.unpack_from('<%dI' % (nargs,), data, pos)
+        pos += nargs * 4
+        try:
+            message = FORMATS[logid](*args)
+        except (KeyError, TypeError):
+            message = 'record 0x%02x %s' % (logid, args)
+        records.append((timestamp, message))
+    return records
+
+# vim: set sw=4 et:
@@ -0,0 +1,146 @@
+#
+# Frame recording container for camview.py
+#
+# File layout, all little endian:
+#
+#   file header    'OVREC\0', version (u16)
+#   frame record   'OVFR', seq (u32), device timestamp in ms (u32),
+#                  format (u8), camera (u8), width (u16), height (u16),
+#                  payload length (u32), payload
+#   ...
+#   index          'OVIX', frame count (u32),
+#                  per frame: record offset (u64), seq (u32), timestamp (u32)
+#   trailer        index offset (u64), 'OVIX'
+#
+# Records are only ever appended, the index is written on close. A file
+# without one (crash, pulled cable) is still readable, the player falls
+# back to scanning the records.
+
+import mmap
+import struct
+import threading
+import Queue
+
+FILE_MAGIC = 'OVREC\0'
+FILE_VERSION = 1
+FILE_HEADER_FORMAT = '<6sH'
+FILE_HEADER_SIZE = struct.calcsize(FILE_HEADER_FORMAT)
+
+RECORD_MAGIC = 'OVFR'
+RECORD_FORMAT = '<4sIIBBHHI'
+RECORD_SIZE = struct.calcsize(RECORD_FORMAT)
+
+INDEX_MAGIC = 'OVIX'
+INDEX_HEADER_FORMAT = '<4sI'
+INDEX_HEADER_SIZE = struct.calcsize(INDEX_HEADER_FORMAT)
+INDEX_ENTRY_FORMAT = '<QII'
+INDEX_ENTRY_SIZE = struct.calcsize(INDEX_ENTRY_FORMAT)
+TRAILER_FORMAT = '<Q4s'
+TRAILER_SIZE = struct.calcsize(TRAILER_FORMAT)
+
+class Recorder(object):
+    """ Appends frames from a writer thread so the reactor never waits
+    on the disk """
+
+    def __init__(self, filename):
+        self.f = open(filename, 'wb')
+        self.f.write(struct.pack(FILE_HEADER_FORMAT, FILE_MAGIC,
+            FILE_VERSION))
+        self.index = []
+        self.queue = Queue.Queue()
+        self.thread = threading.Thread(target=self.writer)
+        self.thread.daemon = True
+        self.thread.start()
+
+    def add(self, header, payload):
+        self.queue.put((header, payload))
+
+    def writer(self):
+        while True:
+            item = self.queue.get()
+            if item is None:
+                break
+            header, payload = item
+            self.index.append((self.f.tell(), header['seq'],
+                header['timestamp']))
+            self.f.write(struct.pack(RECORD_FORMAT, RECORD_MAGIC,
+                header['seq'], header['timestamp'], header['format'],
+                header.get('camera', 0),
+                header['width'], header['height'], len(payload)))
+            self.f.write(payload)
+
+    def close(self):
+        self.queue.put(None)
+        self.thread.join()
+        offset = self.f.tell()
+        self.f.write(struct.pack(INDEX_HEADER_FORMAT, INDEX_MAGIC,
+            len(self.index)))
+        for entry in self.index:
+            self.f.write(struct.pack(INDEX_ENTRY_FORMAT, *entry))
+        self.f.write(struct.pack(TRAILER_FORMAT, offset, INDEX_MAGIC))
+        self.f.close()
+
+class Player(object):
+    """ Random access to a recording through mmap """
+
+    def __init__(self, filename):
+        self.f = open(filename, 'rb')
+        self.m = mmap.mmap(self.f.fileno(), 0, access=mmap.ACCESS_READ)
+        magic, version = struct.unpack(FILE_HEADER_FORMAT,
+            self.m[:FILE_HEADER_SIZE])
+        if magic != FILE_MAGIC or version != FILE_VERSION:
+            raise ValueError('%s is not a recording' % (filename,))
+        self.index = self.readindex()
+        if self.index is None:
+            self.index = self.scan()
+
+    def readindex(self):
+        if len(self.m) < FILE_HEADER_SIZE + TRAILER_SIZE:
+            return None
+        offset, magic = struct.unpack(TRAILER_FORMAT,
+            self.m[-TRAILER_SIZE:])
+        if magic != INDEX_MAGIC or \
+                offset + INDEX_HEADER_SIZE > len(self.m) - TRAILER_SIZE:
+            return None
+        magic, count = struct.unpack(INDEX_HEADER_FORMAT,
+            self.m[offset:offset + INDEX_HEADER_SIZE])
+        start = offset + INDEX_HEADER_SIZE
+        if magic != INDEX_MAGIC or \
+                start + count * INDEX_ENTRY_SIZE + TRAILER_SIZE != len(self.m):
+            return None
+        return [struct.unpack_from(INDEX_ENTRY_FORMAT, self.m,
+                start + i * INDEX_ENTRY_SIZE) for i in range(0, count)]
+
+    def scan(self):
+        index = []
+        offset = FILE_HEADER_SIZE
+        while offset + RECORD_SIZE <= len(self.m):
+            magic, seq, timestamp, fmt, camera, width, height, length = \
+                struct.unpack_from(RECORD_FORMAT, self.m, offset)
+            if magic != RECORD_MAGIC or \
+                    offset + RECORD_SIZE + length > len(self.m):
+                break
+            index.append((offset, seq, timestamp))
+            offset += RECORD_SIZE + length
+        return index
+
+    def __len__(self):
+        return len(self.index)
+
+    def timestamp(self, i):
+        return self.index[i][2]
+
+    def frame(self, i):
+        offset = self.index[i][0]
+        magic, seq, timestamp, fmt, camera, width, height, length = \
+            struct.unpack_from(RECORD_FORMAT, self.m, offset)
+        header = {'seq': seq, 'timestamp': timestamp, 'format': fmt,
+            'camera': camera, 'width': width, 'height': height}
+        start = offset + RECORD_SIZE
+        return header, self.m[start:start + length]
+
+    def close(self):
+        self.m.close()
+        self.f.close()
+
+# vim: set sw=4 et:
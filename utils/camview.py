@@ -6,6 +6,7 @@
 #  zope.interface
 # pyserial
 # pygame
+# numpy
 # pywin32
 
 from twisted.internet import reactor
@@ -15,102 +16,704 @@ from twisted.internet.defer import inlineCallbacks
 from twisted.internet.task import LoopingCall
 from twisted.internet.serialport import SerialPort
 import pygame
+import numpy
 import sys
 import pickle
+import struct
+from optparse import OptionParser
+import camrecord
+import camlog
 
-def parsergb565(byte1, byte2):
-    byte12 = byte1 << 8 | byte2
+def makergb565lut():
+    """ rgb888 triplet for every big endian rgb565 pixel value """
+    v = numpy.arange(0x10000, dtype=numpy.uint32)
+    lut = numpy.empty((0x10000, 3), dtype=numpy.uint8)
+    lut[:, 0] = (v >> 11) << 3
+    lut[:, 1] = ((v >> 5) & 0x3f) << 2
+    lut[:, 2] = (v & 0x1f) << 3
+    return lut
 
-    red = byte12 >> 8+3
-    green = (byte12 >> 5) & 0x3f
-    blue = byte12 & 0x1f
-    
-    red *= 8
-    green *= 4
-    blue *= 8
+RGB565_LUT = makergb565lut()
 
-    return (red, green, blue)
+def decodergb565(data, width, height):
+    """ whole frame of rgb565 bytes to a (width, height, 3) surfarray """
+    pixels = numpy.frombuffer(data, dtype='>u2').reshape(height, width)
+    return RGB565_LUT[pixels.T]
+
+def decodeyuv422(data, width, height):
+    """ whole frame of y u y v bytes to a (width, height, 3) surfarray """
+    p = numpy.frombuffer(data, dtype=numpy.uint8).reshape(
+        height, width / 2, 4).astype(numpy.int32)
+    y = p[:, :, 0::2].reshape(height, width)
+    u = numpy.repeat(p[:, :, 1], 2, axis=1) - 128
+    v = numpy.repeat(p[:, :, 3], 2, axis=1) - 128
+    # bt.601 in 8.8 fixed point
+    rgb = numpy.dstack((y + ((359 * v) >> 8),
+        y - ((88 * u + 183 * v) >> 8),
+        y + ((454 * u) >> 8)))
+    return numpy.clip(rgb, 0, 255).astype(numpy.uint8).transpose(1, 0, 2)
+
+def decodeluma(data, width, height):
+    """ whole frame of grey bytes to a (width, height, 3) surfarray """
+    y = numpy.frombuffer(data, dtype=numpy.uint8).reshape(height, width)
+    return numpy.repeat(y.T[:, :, numpy.newaxis], 3, axis=2)
+
+def decodeedges(data, width, height):
+    """ 1 bit per pixel map, rows padded to bytes, to a surfarray """
+    bits = numpy.unpackbits(numpy.frombuffer(data, dtype=numpy.uint8).reshape(
+        height, (width + 7) / 8), axis=1)[:, :width] * 255
+    return numpy.repeat(bits.T[:, :, numpy.newaxis], 3, axis=2)
+
+# colours of the top left 2x2 block, the sensor sends bggr rows but the
+# mirroring in ov7670_init() makes it gbrg
+BAYER_PATTERNS = ['bggr', 'gbrg', 'grbg', 'rggb']
+bayer_pattern = 'gbrg'
+
+def blur121(a):
+    """ [1 2 1] x [1 2 1] sum over the last two axes, edges mirrored so the
+    bayer phase is kept """
+    p = numpy.pad(a, ((0, 0), (1, 1), (1, 1)), mode='reflect')
+    p = p[:, :, :-2] + 2 * p[:, :, 1:-1] + p[:, :, 2:]
+    return p[:, :-2] + 2 * p[:, 1:-1] + p[:, 2:]
+
+def decodebayer(data, width, height):
+    """ bilinear demosaic of one colour per pixel to a surfarray: the
+    weighted mean of the samples of each colour in the 3x3 neighbourhood,
+    which is exactly the usual bilinear kernels on a bayer grid """
+    raw = numpy.frombuffer(data, dtype=numpy.uint8).reshape(
+        height, width).astype(numpy.int32)
+    planes = numpy.zeros((3, height, width), dtype=numpy.int32)
+    masks = numpy.zeros((3, height, width), dtype=numpy.int32)
+    for i, colour in enumerate(bayer_pattern):
+        c = 'rgb'.index(colour)
+        planes[c, i / 2::2, i % 2::2] = raw[i / 2::2, i % 2::2]
+        masks[c, i / 2::2, i % 2::2] = 1
+    rgb = blur121(planes) / numpy.maximum(blur121(masks), 1)
+    rgb = numpy.where(masks, planes, rgb)
+    return rgb.astype(numpy.uint8).transpose(2, 1, 0)
+
+def makergb332lut():
+    """ rgb888 triplet for every rrrgggbb byte """
+    v = numpy.arange(0x100, dtype=numpy.uint32)
+    lut = numpy.empty((0x100, 3), dtype=numpy.uint8)
+    lut[:, 0] = (v >> 5) * 255 / 7
+    lut[:, 1] = ((v >> 2) & 0x07) * 255 / 7
+    lut[:, 2] = (v & 0x03) * 255 / 3
+    return lut
+
+RGB332_LUT = makergb332lut()
+
+def decodergb332(data, width, height):
+    """ whole frame of rgb332 bytes to a (width, height, 3) surfarray """
+    pixels = numpy.frombuffer(data, dtype=numpy.uint8).reshape(height, width)
+    return RGB332_LUT[pixels.T]
+
+# see quant_palette() in the firmware
+PALETTE_SIZE = 512
+
+def decodepalette(data, width, height):
+    """ rgb565 palette followed by one index per pixel to a surfarray """
+    palette = RGB565_LUT[numpy.frombuffer(data[:PALETTE_SIZE], dtype='>u2')]
+    pixels = numpy.frombuffer(data[PALETTE_SIZE:],
+        dtype=numpy.uint8).reshape(height, width)
+    return palette[pixels.T]
+
+# see blob_pack() in the firmware
+BLOB_FORMAT = '<B7H'
+BLOB_SIZE = struct.calcsize(BLOB_FORMAT)
+BLOB_COLOURS = [(255, 0, 0), (0, 255, 0), (0, 0, 255), (255, 255, 0),
+    (255, 0, 255), (0, 255, 255), (255, 128, 0), (255, 255, 255)]
+
+def parseblobs(data):
+    blobs = []
+    for i in range(0, len(data) / BLOB_SIZE):
+        cls, area, cx, cy, x0, y0, x1, y1 = struct.unpack_from(BLOB_FORMAT,
+            data, i * BLOB_SIZE)
+        blobs.append({'class': cls, 'area': area, 'centroid': (cx, cy),
+            'box': (x0, y0, x1, y1)})
+    return blobs
+
+def decodeblobs(data, width, height):
+    """ blob records to boxes and centroids on black """
+    rgb = numpy.zeros((width, height, 3), dtype=numpy.uint8)
+    for blob in parseblobs(data):
+        x0, y0, x1, y1 = blob['box']
+        colour = BLOB_COLOURS[blob['class'] % len(BLOB_COLOURS)]
+        rgb[x0:x1 + 1, (y0, y1)] = colour
+        rgb[(x0, x1), y0:y1 + 1] = colour
+        rgb[blob['centroid']] = colour
+    return rgb
+
+# see stats_pack() in the firmware
+STATS_FORMAT = '<I16H3I6B2H'
+STATS_SIZE = struct.calcsize(STATS_FORMAT)
+
+def parsestats(data):
+    v = struct.unpack(STATS_FORMAT, data)
+    pixels = v[0] or 1
+    return {
+        'pixels': v[0],
+        'hist': v[1:17],
+        'mean': (v[17] * 8.0 / pixels, v[18] * 4.0 / pixels,
+            v[19] * 8.0 / pixels),
+        'min': (v[20] * 8, v[22] * 4, v[24] * 8),
+        'max': (v[21] * 8, v[23] * 4, v[25] * 8),
+        'clip_lo': v[26],
+        'clip_hi': v[27],
+        }
+
+# see ov7670_pack_info() in the firmware
+INFO_FORMAT = '<3I5H'
+INFO_SIZE = struct.calcsize(INFO_FORMAT)
+
+def parseinfo(data):
+    v = struct.unpack(INFO_FORMAT, data)
+    return dict(zip(('seq', 'timestamp', 'bytes', 'lines',
+        'minbytes', 'maxbytes', 'badlines', 'skipped'), v))
+
+# line order of a polled frame, every 8th line first and then the gaps
+INTERLACE_PASSES = [(0, 8), (4, 8), (2, 4), (1, 2)]
+
+def interlace(height, unit=1):
+    """ line numbers of each pass, bayer lines go in pairs so that every
+    pass has all the colours """
+    rows = (height + unit - 1) / unit
+    return [[r * unit + i for r in range(start, rows, step)
+        for i in range(0, unit) if r * unit + i < height]
+        for start, step in INTERLACE_PASSES]
+
+def filllines(lines, pitch, unit=1):
+    """ a partial frame with the gaps filled by repeating the line above
+    of the same bayer phase, black if there isn't one yet """
+    last = {}
+    out = []
+    for i, line in enumerate(lines):
+        if line is not None:
+            last[i % unit] = line
+        out.append(last.get(i % unit, '\0' * pitch))
+    return out
+
+# see stream.h in the firmware
+STREAM_MAGIC = 'OV76'
+STREAM_HEADER_FORMAT = '<4sIIBBHHIH'
+STREAM_HEADER_SIZE = struct.calcsize(STREAM_HEADER_FORMAT)
+
+FMT_RGB565 = 0x01
+FMT_YUV422 = 0x02
+FMT_LUMA = 0x03
+FMT_EDGES = 0x04
+FMT_BLOBS = 0x05
+FMT_BAYER = 0x06
+FMT_RGB332 = 0x07
+FMT_PALETTE = 0x08
+
+# decoder and bytes per row for a width, blobs have no rows. Palette
+# frames carry the palette ahead of the rows.
+DECODERS = {
+    FMT_RGB565: (decodergb565, lambda w: w * 2),
+    FMT_YUV422: (decodeyuv422, lambda w: w * 2),
+    FMT_LUMA: (decodeluma, lambda w: w),
+    FMT_EDGES: (decodeedges, lambda w: (w + 7) / 8),
+    FMT_BLOBS: (decodeblobs, None),
+    FMT_BAYER: (decodebayer, lambda w: w),
+    FMT_RGB332: (decodergb332, lambda w: w),
+    FMT_PALETTE: (decodepalette, lambda w: w),
+    }
+
+PAYLOAD_EXTRA = {FMT_PALETTE: PALETTE_SIZE}
+
+class FrameParser(object):
+    """ Splits the pushed stream into frames, resyncing on the magic """
+
+    def __init__(self, callback):
+        self.callback = callback
+        self.buf = ''
+
+    def feed(self, data):
+        self.buf += data
+        while True:
+            i = self.buf.find(STREAM_MAGIC)
+            if i < 0:
+                # keep a possible partial magic
+                self.buf = self.buf[-(len(STREAM_MAGIC) - 1):]
+                return
+            if i > 0:
+                self.buf = self.buf[i:]
+            if len(self.buf) < STREAM_HEADER_SIZE:
+                return
+            magic, seq, timestamp, fmt, camera, width, height, length, \
+                skipped = struct.unpack(STREAM_HEADER_FORMAT,
+                    self.buf[:STREAM_HEADER_SIZE])
+            end = STREAM_HEADER_SIZE + length
+            if len(self.buf) < end:
+                return
+            header = {'seq': seq, 'timestamp': timestamp, 'format': fmt,
+                'camera': camera, 'width': width, 'height': height,
+                'skipped': skipped}
+            payload = self.buf[STREAM_HEADER_SIZE:end]
+            self.buf = self.buf[end:]
+            self.callback(header, payload)
+
+# see proto.h in the firmware
+PROTO_SYNC = '\xa5'
+PROTO_HEADER_FORMAT = '<cBBBH'
+PROTO_HEADER_SIZE = struct.calcsize(PROTO_HEADER_FORMAT)
+PROTO_MAX_REPLY = 640
+
+PROTO_PING = 0x01
+PROTO_CAPTURE = 0x02
+PROTO_INFO = 0x03
+PROTO_LINEBYTES = 0x04
+PROTO_STATS = 0x05
+PROTO_GETLINE = 0x06
+PROTO_CAM = 0x07
+PROTO_MODE = 0x08
+PROTO_SET_MODE = 0x09
+PROTO_REG_READ = 0x0a
+PROTO_REG_WRITE = 0x0b
+PROTO_STREAM = 0x0c
+PROTO_LOG = 0x0d
+PROTO_BOOT = 0x0e
+PROTO_PERF = 0x0f
+
+# see perf_pack() in the firmware, times are in cpu cycles
+PERF_FIELDS = ['frames', 'capture_avg', 'capture_max', 'lines', 'line_avg',
+    'line_max', 'tx_bytes', 'uart_overrun', 'uart_framing', 'i2c_nack',
+    'i2c_arb_loss', 'commands', 'command_avg', 'command_max', 'uptime',
+    'core_sleep', 'sensor_sleep', 'wakes', 'wake_avg', 'wake_max', 'cclk']
+
+# see boot.h in the firmware
+BOOT_CHECKPOINTS = ['data', 'bss', 'sysinit', 'board', 'cams', 'mainloop',
+    'firstframe']
+
+PROTO_OK = 0
+
+# requests in flight, the device buffers 256 bytes of them
+PIPELINE_DEPTH = 8
+
+# a lost or short line is asked for again this soon, this many times
+LINE_TIMEOUT = 0.25
+LINE_ATTEMPTS = 4
+
+# see stream.h in the firmware
+STREAM_FORMATS = {'raw': 1, 'thumb1': 2, 'thumb2': 3, 'thumb1-luma': 4,
+    'thumb2-luma': 5, 'edges': 6, 'blobs': 7, 'rgb332': 8, 'palette': 9}
+
+def makecrctable():
+    table = []
+    for i in range(0, 256):
+        crc = i << 8
+        for j in range(0, 8):
+            crc = ((crc << 1) ^ 0x1021 if crc & 0x8000 else crc << 1) & 0xffff
+        table.append(crc)
+    return table
+
+CRC_TABLE = makecrctable()
+
+def crc16(data, crc=0xffff):
+    """ crc16-ccitt, as proto_crc16() in the firmware """
+    for c in data:
+        crc = ((crc << 8) & 0xffff) ^ CRC_TABLE[(crc >> 8) ^ ord(c)]
+    return crc
 
 class SpecialSerialProtocol(protocol.Protocol):
+    """ Framed binary requests, several can be in flight and replies are
+    matched to them by request id """
 
-    recvd = ''
-    dataDeferred = None
-    clearSchedule = None
-    dataSize = 0
+    def __init__(self):
+        self.recvd = ''
+        self.pending = {}
+        self.nextid = 0
 
     def dataReceived(self, data):
-        for c in data:
-            if self.dataDeferred and self.dataSize:
-                self.recvd += c
-                self.dataSize -= 1
-                if self.dataSize == 0:
-                    self.endDataHandler()
-            elif self.dataDeferred and not self.dataSize:
-                if c == '\n':
-                    self.endDataHandler()
-                elif c == '\r':
-                    continue
-                else:
-                    self.recvd += c
-            else:
-                print 'Unhandled data: [%s]' % (c,)
-
-    def endDataHandler(self):
-        cb = self.dataDeferred.callback
-        data = self.recvd
-        self.dataDeferred = None
-        self.dataSize = 0
-        self.recvd = ''
-        if not self.clearSchedule.called:
-            self.clearSchedule.cancel()
-        self.clearSchedule = None
-        cb(data)
-
-    def converse(self, msg, size = None, timeout = 1):
-        if self.dataDeferred is not None:
-            raise Exception, 'write callback already in progress!'
+        self.recvd += data
+        while True:
+            i = self.recvd.find(PROTO_SYNC)
+            if i < 0:
+                self.recvd = ''
+                return
+            self.recvd = self.recvd[i:]
+            if len(self.recvd) < PROTO_HEADER_SIZE:
+                return
+            sync, opcode, reqid, status, length = struct.unpack(
+                PROTO_HEADER_FORMAT, self.recvd[:PROTO_HEADER_SIZE])
+            end = PROTO_HEADER_SIZE + length + 2
+            if length > PROTO_MAX_REPLY:
+                self.recvd = self.recvd[1:]
+                continue
+            if len(self.recvd) < end:
+                return
+            msg = self.recvd[:end]
+            if struct.unpack('<H', msg[-2:])[0] != crc16(msg[1:-2]):
+                # not a reply after all, or a damaged one
+                self.recvd = self.recvd[1:]
+                continue
+            self.recvd = self.recvd[end:]
+            self.replyReceived(opcode, reqid, status,
+                msg[PROTO_HEADER_SIZE:-2])
+
+    def replyReceived(self, opcode, reqid, status, payload):
+        if opcode == PROTO_LOG and (reqid not in self.pending or
+                self.pending[reqid][0] != PROTO_LOG):
+            # pushed while the device was idle
+            self.logReceived(payload)
+            return
+        if reqid not in self.pending or self.pending[reqid][0] != opcode:
+            print 'Unexpected reply (opcode %d, id %d)' % (opcode, reqid)
+            return
+        opcode, d, timeout = self.pending.pop(reqid)
+        timeout.cancel()
+        d.callback((status, payload))
+
+    def logReceived(self, payload):
+        for timestamp, message in camlog.parse(payload):
+            print '[%d.%03d] %s' % (timestamp / 1000, timestamp % 1000, message)
+
+    def requestTimeout(self, reqid):
+        opcode, d, timeout = self.pending.pop(reqid)
+        d.callback((None, ''))
+
+    def request(self, opcode, payload = '', timeout = 1):
+        """ fires with (status, payload), status is None on timeout """
+        reqid = self.nextid
+        if reqid in self.pending:
+            raise Exception, 'too many requests in flight!'
+        self.nextid = (self.nextid + 1) % 256
         d = defer.Deferred()
-        self.dataDeferred = d
-        if size:
-            self.dataSize = size
-        if timeout:
-            self.clearSchedule = \
-                reactor.callLater(timeout, self.endDataHandler)
-        self.transport.write(msg)
+        self.pending[reqid] = (opcode, d,
+            reactor.callLater(timeout, self.requestTimeout, reqid))
+        msg = struct.pack(PROTO_HEADER_FORMAT, PROTO_SYNC, opcode, reqid, 0,
+            len(payload)) + payload
+        self.transport.write(msg + struct.pack('<H', crc16(msg[1:])))
         return d
 
-
 class OV7670Test(SpecialSerialProtocol):
 
+    lastseq = None
+    retries = 0
+    lastinfo = None
+    parser = None
+
+    @inlineCallbacks
+    def checkframe(self):
+        status, data = yield self.request(PROTO_INFO)
+        if len(data) != INFO_SIZE:
+            print 'Short info reply (%d bytes)' % (len(data),)
+            return
+        info = parseinfo(data)
+        self.lastinfo = info
+        if info['badlines']:
+            print 'Frame %(seq)d: %(lines)d lines, %(badlines)d bad ' \
+                '(%(minbytes)d..%(maxbytes)d bytes)' % info
+        if self.lastseq is not None and info['seq'] != self.lastseq + 1:
+            print 'Frame %d: sequence jumped from %d' % \
+                (info['seq'], self.lastseq)
+        self.lastseq = info['seq']
+
     @inlineCallbacks
     def getlines(self):
-        ok = yield self.converse('getimage\r')
-        newbuf = self.transport.app.imgbuf[:]
-        for i in range(0, 120):
-            data = ''
-            while len(data) != 320:
-                data = yield self.converse('getline %d\r' % (i,), 320)
-            newbuf[i] = data
-        self.transport.app.imgbuf = newbuf[:]
+        status, data = yield self.request(PROTO_CAPTURE, timeout = 2)
+        if status is not None and status != PROTO_OK:
+            print 'Capture failed: %s' % (camlog.CAPTURE_ERRORS.get(
+                ord(data[:1] or '\0'), 'unknown error'),)
+            return
+        self.lastinfo = None
+        yield self.checkframe()
+        status, data = yield self.request(PROTO_MODE)
+        if status != PROTO_OK:
+            print 'No mode reply'
+            return
+        width, height, fmt = struct.unpack('<HHB', data[:5])
+        pitch = DECODERS[fmt][1](width)
+        unit = 2 if fmt == FMT_BAYER else 1
+        header = {'seq': 0, 'timestamp': 0}
+        if self.lastinfo:
+            header.update(self.lastinfo)
+        header.update({'format': fmt, 'camera': 0,
+            'width': width, 'height': height})
+        lines = [None] * height
+        passes = interlace(height, unit)
+        pending = [len(p) for p in passes]
+        shown = [0]
+
+        def received(data, i, p):
+            lines[i] = data
+            pending[p] -= 1
+            # a preview after each finished pass but the last
+            while shown[0] < len(passes) - 1 and not pending[shown[0]]:
+                shown[0] += 1
+                self.transport.app.showpreview(header,
+                    ''.join(filllines(lines, pitch, unit)))
+            return data
+
+        # coarse to fine, a few lines in flight, each retried in its slot
+        self.retries = 0
+        sem = defer.DeferredSemaphore(PIPELINE_DEPTH)
+        yield defer.gatherResults([sem.run(self.getline, i, pitch
+            ).addCallback(received, i, p)
+            for p, order in enumerate(passes) for i in order])
+        if self.retries:
+            print 'Frame %d: %d line requests retried' % (header['seq'],
+                self.retries)
+        if None in lines:
+            print 'Frame %d: gave up on line %d' % (header['seq'],
+                lines.index(None))
+            return
+        self.transport.app.showframe(header, ''.join(lines))
+
+    @inlineCallbacks
+    def getline(self, i, pitch):
+        """ fires with the line, or None if it never came whole """
+        for attempt in range(0, LINE_ATTEMPTS):
+            status, data = yield self.request(PROTO_GETLINE,
+                struct.pack('<H', i), timeout = LINE_TIMEOUT)
+            if status == PROTO_OK and len(data) == pitch:
+                defer.returnValue(data)
+            self.retries += 1
+        defer.returnValue(None)
+
+    @inlineCallbacks
+    def getstats(self):
+        status, data = yield self.request(PROTO_STATS)
+        if len(data) != STATS_SIZE:
+            print 'Short stats reply (%d bytes)' % (len(data),)
+            return
+        stats = parsestats(data)
+        print 'mean rgb %.1f %.1f %.1f, clipped %d/%d, hist %s' % (
+            stats['mean'] + (stats['clip_lo'], stats['clip_hi'],
+                ' '.join(str(h) for h in stats['hist'])))
+
+    def dataReceived(self, data):
+        if self.parser:
+            self.parser.feed(data)
+        else:
+            SpecialSerialProtocol.dataReceived(self, data)
+
+    def startStream(self):
+        self.parser = FrameParser(self.frameReceived)
+        # the reply goes to the parser, which drops it
+        self.request(PROTO_STREAM, struct.pack('<HB',
+            self.transport.app.options.stream,
+            STREAM_FORMATS[self.transport.app.options.format]))
+
+    def stopStream(self):
+        # the parser stays, it drops the tail of the last frame and the reply
+        self.request(PROTO_STREAM, struct.pack('<HB', 0, 0))
+
+    def frameReceived(self, header, payload):
+        if header['format'] == FMT_BLOBS and len(payload) % BLOB_SIZE == 0:
+            for blob in parseblobs(payload):
+                print 'Frame %d: blob %d, %d pixels at %s, box %s' % (
+                    header['seq'], blob['class'], blob['area'],
+                    blob['centroid'], blob['box'])
+            self.transport.app.showframe(header, payload)
+            return
+        if header['format'] not in DECODERS or \
+                DECODERS[header['format']][1] is None or len(payload) != \
+                DECODERS[header['format']][1](header['width']) * \
+                header['height'] + PAYLOAD_EXTRA.get(header['format'], 0):
+            print 'Bad frame %(seq)d (format %(format)d, ' \
+                '%(width)dx%(height)d)' % header
+            return
+        if self.lastseq is not None and header['seq'] != self.lastseq + 1:
+            print 'Lost %d frames on the link before %d' % \
+                (header['seq'] - self.lastseq - 1, header['seq'])
+        # at a stream interval of 0 every sensor frame should be captured
+        if header['skipped'] and not self.transport.app.options.stream:
+            print 'Sensor frames dropped before %d: %d' % \
+                (header['seq'], header['skipped'])
+        self.lastseq = header['seq']
+        self.transport.app.showframe(header, payload)
+
+    @inlineCallbacks
+    def getlog(self):
+        # what's there now, and have the device push the rest when idle
+        status, data = yield self.request(PROTO_LOG, chr(1))
+        if status == PROTO_OK:
+            self.logReceived(data)
+
+    @inlineCallbacks
+    def getboot(self):
+        status, data = yield self.request(PROTO_BOOT)
+        if status != PROTO_OK or len(data) != 4 * len(BOOT_CHECKPOINTS):
+            return
+        times = struct.unpack('<%dI' % (len(BOOT_CHECKPOINTS),), data)
+        print 'Boot: ' + ', '.join('%s %.1f ms' % (name, us / 1000.0)
+            for name, us in zip(BOOT_CHECKPOINTS, times) if us)
+
+    @inlineCallbacks
+    def getperf(self, reset=True):
+        # counters since the last reset
+        status, data = yield self.request(PROTO_PERF, chr(int(reset)))
+        if status != PROTO_OK or len(data) != 4 * len(PERF_FIELDS):
+            return
+        perf = dict(zip(PERF_FIELDS,
+            struct.unpack('<%dI' % (len(PERF_FIELDS),), data)))
+        us = 1e6 / perf['cclk']
+        print 'Perf: %d frames, capture %.1f/%.1f ms, ' \
+            'line %.1f/%.1f us, command %.1f/%.1f ms (avg/max)' % \
+            (perf['frames'], perf['capture_avg'] * us / 1000,
+            perf['capture_max'] * us / 1000, perf['line_avg'] * us,
+            perf['line_max'] * us, perf['command_avg'] * us / 1000,
+            perf['command_max'] * us / 1000)
+        print 'Perf: %d bytes sent, uart %d overrun %d framing, ' \
+            'i2c %d nack %d arbitration lost' % \
+            (perf['tx_bytes'], perf['uart_overrun'], perf['uart_framing'],
+            perf['i2c_nack'], perf['i2c_arb_loss'])
+        self.printpower(perf)
+
+    def printpower(self, perf):
+        """ time in each power state per frame, and the energy if the
+        board's figures were given with --power """
+        frames = perf['frames'] or 1
+        awake = perf['uptime'] - perf['core_sleep']
+        sensor = perf['uptime'] * self.transport.app.options.cameras - \
+            perf['sensor_sleep']
+        print 'Power: core awake %.1f ms asleep %.1f ms, sensors on ' \
+            '%.1f ms per frame, wake to frame %d/%d ms (avg/max, %d wakes)' % \
+            (float(awake) / frames, float(perf['core_sleep']) / frames,
+            float(sensor) / frames, perf['wake_avg'], perf['wake_max'],
+            perf['wakes'])
+        power = self.transport.app.options.power
+        if power:
+            # ms * mW = uJ
+            print 'Power: %.2f mJ per frame' % ((awake * power[0] +
+                perf['core_sleep'] * power[1] + sensor * power[2]) /
+                1000.0 / frames,)
 
     def connectionMade(self):
+        if self.transport.app.options.stream is not None:
+            self.startStream()
+            return
+        self.getboot()
+        self.getlog()
         self.refresh = LoopingCall(self.getlines)
         self.refresh.start(0.001)
 
+class Playback(object):
+    """ Replays a recording, paced by the device timestamps """
+
+    def __init__(self, app, filename, speed):
+        self.app = app
+        self.player = camrecord.Player(filename)
+        self.speed = speed
+        self.pos = 0
+        self.call = None
+        print '%s: %d frames' % (filename, len(self.player))
+        if len(self.player):
+            self.show()
+            self.play()
+
+    def show(self):
+        header, payload = self.player.frame(self.pos)
+        self.app.showframe(header, payload)
+
+    def schedule(self):
+        if self.pos + 1 >= len(self.player):
+            self.call = None
+            return
+        delay = 0
+        if self.speed:
+            delay = ((self.player.timestamp(self.pos + 1) -
+                self.player.timestamp(self.pos)) & 0xffffffff) / \
+                1000.0 / self.speed
+        self.call = reactor.callLater(delay, self.advance)
+
+    def advance(self):
+        self.pos += 1
+        self.show()
+        self.schedule()
+
+    def play(self):
+        if self.call is None:
+            self.schedule()
+
+    def pause(self):
+        if self.call is not None:
+            self.call.cancel()
+            self.call = None
+
+    def toggle(self):
+        if self.call is None:
+            self.play()
+        else:
+            self.pause()
+
+    def seek(self, pos):
+        if not len(self.player):
+            return
+        self.pos = min(max(pos, 0), len(self.player) - 1)
+        self.show()
+        if self.call is not None:
+            self.call.cancel()
+            self.schedule()
+
+    def setspeed(self, speed):
+        self.speed = speed
+        print 'Playback speed %gx' % (speed,)
+
+    def key(self, key):
+        if key == pygame.K_SPACE:
+            self.toggle()
+        elif key == pygame.K_LEFT:
+            self.seek(self.pos - 1)
+        elif key == pygame.K_RIGHT:
+            self.seek(self.pos + 1)
+        elif key == pygame.K_PAGEUP:
+            self.seek(self.pos - max(len(self.player) / 10, 1))
+        elif key == pygame.K_PAGEDOWN:
+            self.seek(self.pos + max(len(self.player) / 10, 1))
+        elif key == pygame.K_HOME:
+            self.seek(0)
+        elif key == pygame.K_END:
+            self.seek(len(self.player) - 1)
+        elif key in (pygame.K_PLUS, pygame.K_EQUALS, pygame.K_KP_PLUS):
+            self.setspeed(self.speed * 2)
+        elif key in (pygame.K_MINUS, pygame.K_KP_MINUS):
+            self.setspeed(self.speed / 2)
+
+    def close(self):
+        self.pause()
+        self.player.close()
+
 class Application(object):
-    def __init__(self):
-        self.screen = pygame.display.set_mode((320, 240))
-        self.imgbuf = ['\0' * 320] * 120
+    def __init__(self, options):
+        self.options = options
+        # frames from several sensors go side by side
+        self.screen = pygame.display.set_mode((320 * options.cameras, 240))
+        self.frames = {}
+        self.drawn = {}
+        self.recorder = None
+        self.playback = None
         self.tick = LoopingCall(self.game_tick)
-        self.tick.start(1.0 / 15) # desired FPS
+        self.tick.start(1.0 / 60) # desired FPS, only new frames are drawn
+        if options.play:
+            self.playback = Playback(self, options.play, options.speed)
+            return
+        if options.record:
+            self.recorder = camrecord.Recorder(options.record)
         # Set up anything else twisted here, like listening sockets
         self.ov7670 = OV7670Test()
-        self.serial = SerialPort(self.ov7670, 5, reactor, baudrate=921600)
+        self.serial = SerialPort(self.ov7670, options.port, reactor,
+            baudrate=921600)
         self.serial.app = self
 
+    def showframe(self, header, payload):
+        if self.recorder:
+            self.recorder.add(header, payload)
+        self.frames[header['camera']] = (header, payload)
+
+    def showpreview(self, header, payload):
+        """ partial frame while lines are still coming, not recorded """
+        self.frames[header['camera']] = (header, payload)
+
     def quit(self):
         print 'Quitting! (or more likely crashing)'
         self.tick.stop()
+        if self.recorder:
+            self.recorder.close()
+        if self.playback:
+            self.playback.close()
         reactor.stop()
 
     def game_tick(self):
@@ -121,31 +724,99 @@ class Application(object):
             elif (event.type == pygame.KEYDOWN):
                 if (event.key == pygame.K_q):
                     self.quit()
+                if self.playback:
+                    self.playback.key(event.key)
+                    continue
                 if (event.key == pygame.K_p):
-                    self.ov7670.refresh.stop()
+                    if self.options.stream is not None:
+                        self.ov7670.stopStream()
+                    else:
+                        self.ov7670.refresh.stop()
                 if (event.key == pygame.K_r):
-                    self.ov7670.refresh.start(0.001)
+                    if self.options.stream is not None:
+                        self.ov7670.startStream()
+                    else:
+                        self.ov7670.refresh.start(0.001)
+                # replies to these would go to the frame parser
+                if self.options.stream is not None:
+                    continue
+                if (event.key == pygame.K_i):
+                    self.ov7670.getperf()
+                if (event.key == pygame.K_s):
+                    self.ov7670.getstats()
                 if (event.key == pygame.K_SPACE):
-                    self.imgbuf = ['\0' * 320] * 120
+                    self.frames.pop(0, None)
                     self.ov7670.getlines()
 
     def redraw(self):
-        for y in range(0, 120):
-            i = 0
-            for x in range(0, 160):
-                color = parsergb565(
-                    ord(self.imgbuf[y][i]),
-                    ord(self.imgbuf[y][i + 1]))
-                i += 2
-
-                self.screen.set_at((2 * x, 2 * y), color)
-                self.screen.set_at((2 * x + 1, 2 * y), color)
-                self.screen.set_at((2 * x, 2 * y + 1), color)
-                self.screen.set_at((2 * x + 1, 2 * y + 1), color)
-        pygame.display.flip()
+        changed = False
+        for camera in range(0, self.options.cameras):
+            frame = self.frames.get(camera)
+            if frame is self.drawn.get(camera):
+                continue
+            self.drawn[camera] = frame
+            area = self.screen.subsurface((320 * camera, 0, 320, 240))
+            changed = True
+            if frame is None:
+                area.fill((0, 0, 0))
+                continue
+            header, payload = frame
+            decode = DECODERS[header['format']][0]
+            surface = pygame.surfarray.make_surface(
+                decode(payload, header['width'], header['height']))
+            # keep the aspect, frames cut to fit the device ram are short
+            height = min(240, header['height'] * 320 / header['width'])
+            area.fill((0, 0, 0))
+            pygame.transform.scale(surface, (320, height),
+                area.subsurface((0, 0, 320, height)))
+        if changed:
+            pygame.display.flip()
+
+def port(value):
+    """ pyserial takes either a port number or a device name """
+    try:
+        return int(value)
+    except ValueError:
+        return value
 
 if __name__ == '__main__':
-    Application()
+    parser = OptionParser()
+    parser.add_option('-p', '--port', default=5, type='string',
+        help='serial port number or device [default: %default]')
+    parser.add_option('-s', '--stream', type='int', metavar='FPS',
+        help='let the device push frames at FPS (0 = as fast as it can) '
+        'instead of polling line by line')
+    parser.add_option('-f', '--format', default='raw',
+        choices=sorted(STREAM_FORMATS.keys()),
+        help='stream format: raw, thumb1, thumb2, thumb1-luma, '
+        'thumb2-luma, edges, blobs, rgb332 or palette [default: %default]')
+    parser.add_option('-c', '--cameras', type='int', default=1,
+        help='number of sensors on the device [default: %default]')
+    parser.add_option('-r', '--record', metavar='FILE',
+        help='append every received frame to FILE')
+    parser.add_option('--play', metavar='FILE',
+        help='replay a recording instead of talking to the device')
+    parser.add_option('--speed', type='float', default=1.0,
+        help='playback speed, 0 = as fast as possible [default: %default]')
+    parser.add_option('--bayer', default=bayer_pattern,
+        choices=BAYER_PATTERNS,
+        help='colour order of bayer frames: bggr, gbrg, grbg or rggb '
+        '[default: %default]')
+    parser.add_option('--power', metavar='AWAKE,ASLEEP,SENSOR',
+        help='mW of the core awake and asleep and of a running sensor, '
+        'as measured on the board, to print the energy per frame with the '
+        'perf counters')
+    options, args = parser.parse_args()
+    if options.power:
+        try:
+            options.power = [float(v) for v in options.power.split(',')]
+        except ValueError:
+            options.power = None
+        if not options.power or len(options.power) != 3:
+            parser.error('--power takes three numbers')
+    bayer_pattern = options.bayer
+    options.port = port(options.port)
+    Application(options)
     reactor.run()
 
 # vim: set sw=4 et:
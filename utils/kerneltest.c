@@ -0,0 +1,671 @@
+/*
+ * Host regression suite & benchmark for the firmware image code: stats,
+ * thumbnails, sobel edges, blobs, rgb332 & palette quantization and the
+ * swar kernels run on synthetic qqvga frames (and optionally frames from
+ * the device), and every output is checked
+ *
+ *  - bit for bit against a plain reference written here, where one is
+ *    small enough to trust, and
+ *  - against golden digests recorded for the synthetic frames, so that
+ *    any change in output shows up even if both sides changed.
+ *
+ *   gcc -O2 -I../src -o kerneltest kerneltest.c ../src/stats.c \
+ *       ../src/thumb.c ../src/edge.c ../src/blob.c ../src/quant.c \
+ *       ../src/swar.c
+ *   ./kerneltest [-g] [-n iterations] [frame.raw ...]
+ *
+ * A frame file is a raw qqvga rgb565 stream payload, two bytes per pixel
+ * as captured. One line per kernel and frame: digest, check result and
+ * ns per pixel, so the output of two commits can be diffed. After an
+ * intended change in output, ./kerneltest -g > kerneltest.golden
+ * records the new digests. Exit status is non zero if anything failed.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "pixel.h"
+#include "stats.h"
+#include "thumb.h"
+#include "edge.h"
+#include "blob.h"
+#include "quant.h"
+#include "swar.h"
+
+#define W 160
+#define H 120
+#define PIXELS (W * H)
+
+struct frame {
+    const char *name;
+    uint8_t hi[PIXELS], lo[PIXELS];
+};
+
+struct golden {
+    const char *kernel, *frame;
+    uint32_t digest;
+};
+
+/* see above, only for the synthetic frames */
+static const struct golden goldens[] = {
+#include "kerneltest.golden"
+};
+
+#define NUM_GOLDENS (sizeof(goldens) / sizeof(goldens[0]))
+
+static uint32_t iterations = 100;
+static int print_goldens, failed;
+
+static uint8_t out1[PIXELS * 2], out2[PIXELS * 2], tmp[PIXELS * 2];
+static uint32_t out1_len, collect_len;
+
+/* fnv-1a */
+static uint32_t digest(const uint8_t *p, uint32_t len)
+{
+    uint32_t h = 0x811c9dc5;
+
+    while (len--) {
+        h = (h ^ *p++) * 0x01000193;
+    }
+    return h;
+}
+
+static double now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* --- frames --- */
+
+static void set_pixel(struct frame *f, uint32_t i, uint32_t r, uint32_t g,
+        uint32_t b)
+{
+    f->hi[i] = (r << 3) | (g >> 3);
+    f->lo[i] = (g << 5) | b;
+}
+
+static void make_gradient(struct frame *f)
+{
+    uint32_t x, y;
+
+    for (y = 0; y < H; y ++) {
+        for (x = 0; x < W; x ++) {
+            set_pixel(f, y * W + x, x * 31 / (W - 1), y * 63 / (H - 1),
+                    (x + y) & 31);
+        }
+    }
+}
+
+static void make_bars(struct frame *f)
+{
+    uint32_t x, y, bar;
+
+    for (y = 0; y < H; y ++) {
+        for (x = 0; x < W; x ++) {
+            bar = 7 - x * 8 / W; /* white, yellow, cyan, green, ... */
+            set_pixel(f, y * W + x, bar & 2 ? 31 : 0, bar & 4 ? 63 : 0,
+                    bar & 1 ? 31 : 0);
+        }
+    }
+}
+
+static void make_checker(struct frame *f)
+{
+    uint32_t x, y, on;
+
+    for (y = 0; y < H; y ++) {
+        for (x = 0; x < W; x ++) {
+            on = ((x >> 3) ^ (y >> 3)) & 1;
+            set_pixel(f, y * W + x, on ? 31 : 0, on ? 63 : 0, on ? 31 : 0);
+        }
+    }
+}
+
+/* fixed seed, the same on every host */
+static void make_noise(struct frame *f)
+{
+    uint32_t i, seed = 12345;
+
+    for (i = 0; i < PIXELS; i ++) {
+        seed = seed * 1103515245 + 12345;
+        f->hi[i] = seed >> 16;
+        seed = seed * 1103515245 + 12345;
+        f->lo[i] = seed >> 16;
+    }
+}
+
+/* red & blue discs and a green bar on grey, for the blob finder */
+static void make_spots(struct frame *f)
+{
+    uint32_t x, y, i;
+    int32_t dx, dy;
+
+    for (y = 0; y < H; y ++) {
+        for (x = 0; x < W; x ++) {
+            i = y * W + x;
+            set_pixel(f, i, 12, 24, 12);
+            dx = x - 40;
+            dy = y - 40;
+            if (dx * dx + dy * dy < 20 * 20) set_pixel(f, i, 28, 8, 4);
+            dx = x - 110;
+            dy = y - 80;
+            if (dx * dx + dy * dy < 12 * 12) set_pixel(f, i, 4, 8, 28);
+            if (y >= 100 && y < 106 && x >= 10 && x < 70) {
+                set_pixel(f, i, 4, 56, 4);
+            }
+        }
+    }
+}
+
+static const struct {
+    const char *name;
+    void (*make)(struct frame *f);
+} patterns[] = {
+    { "gradient", make_gradient },
+    { "bars", make_bars },
+    { "checker", make_checker },
+    { "noise", make_noise },
+    { "spots", make_spots },
+};
+
+#define NUM_PATTERNS (sizeof(patterns) / sizeof(patterns[0]))
+
+static int load_frame(struct frame *f, const char *filename)
+{
+    uint8_t buf[PIXELS * 2];
+    FILE *fp = fopen(filename, "rb");
+    uint32_t i;
+
+    if (!fp) {
+        perror(filename);
+        return 0;
+    }
+    if (fread(buf, 1, sizeof(buf), fp) != sizeof(buf)) {
+        fprintf(stderr, "%s: not a qqvga rgb565 frame\n", filename);
+        fclose(fp);
+        return 0;
+    }
+    fclose(fp);
+    for (i = 0; i < PIXELS; i ++) {
+        f->hi[i] = buf[i * 2];
+        f->lo[i] = buf[i * 2 + 1];
+    }
+    f->name = filename;
+    return 1;
+}
+
+/* --- references, written from the formats rather than the firmware --- */
+
+#define R(hi, lo) ((hi) >> 3)
+#define G(hi, lo) ((((hi) & 7) << 3) | ((lo) >> 5))
+#define B(hi, lo) ((lo) & 31)
+#define Y(r, g, b) (((r) * 616 + (g) * 600 + (b) * 232) >> 8)
+
+static uint32_t ref_stats(const struct frame *f, uint8_t *out)
+{
+    struct frame_stats st;
+    uint32_t i, r, g, b;
+
+    memset(&st, 0, sizeof(st));
+    st.min_r = st.min_b = 31;
+    st.min_g = 63;
+    for (i = 0; i < PIXELS; i ++) {
+        r = R(f->hi[i], f->lo[i]);
+        g = G(f->hi[i], f->lo[i]);
+        b = B(f->hi[i], f->lo[i]);
+        st.sum_r += r;
+        st.sum_g += g;
+        st.sum_b += b;
+        st.min_r = r < st.min_r ? r : st.min_r;
+        st.max_r = r > st.max_r ? r : st.max_r;
+        st.min_g = g < st.min_g ? g : st.min_g;
+        st.max_g = g > st.max_g ? g : st.max_g;
+        st.min_b = b < st.min_b ? b : st.min_b;
+        st.max_b = b > st.max_b ? b : st.max_b;
+        if (!r && !g && !b) {
+            st.clip_lo ++;
+        } else if (r == 31 || g == 63 || b == 31) {
+            st.clip_hi ++;
+        }
+        st.hist[Y(r, g, b) / 16] ++;
+    }
+    st.pixels = PIXELS;
+    return stats_pack(&st, out);
+}
+
+static uint32_t ref_thumb(const struct frame *f, uint8_t *out)
+{
+    uint32_t x, y, k, i, r, g, b;
+    uint8_t *p = out;
+
+    for (y = 0; y < H / 2; y ++) {
+        for (x = 0; x < W / 2; x ++) {
+            r = g = b = 0;
+            for (k = 0; k < 4; k ++) {
+                i = (y * 2 + k / 2) * W + x * 2 + k % 2;
+                r += R(f->hi[i], f->lo[i]);
+                g += G(f->hi[i], f->lo[i]);
+                b += B(f->hi[i], f->lo[i]);
+            }
+            r = (r + 2) / 4;
+            g = (g + 2) / 4;
+            b = (b + 2) / 4;
+            *p++ = (r << 3) | (g >> 3);
+            *p++ = ((g & 7) << 5) | b;
+        }
+    }
+    return p - out;
+}
+
+static uint32_t ref_thumb_luma(const struct frame *f, uint8_t *out)
+{
+    uint32_t x, y, k, i, sum;
+    uint8_t *p = out;
+
+    for (y = 0; y < H / 2; y ++) {
+        for (x = 0; x < W / 2; x ++) {
+            sum = 0;
+            for (k = 0; k < 4; k ++) {
+                i = (y * 2 + k / 2) * W + x * 2 + k % 2;
+                sum += Y(R(f->hi[i], f->lo[i]), G(f->hi[i], f->lo[i]),
+                        B(f->hi[i], f->lo[i]));
+            }
+            *p++ = (sum + 2) / 4;
+        }
+    }
+    return p - out;
+}
+
+/* of an interleaved rgb565 image */
+static uint32_t ref_half_rgb565(const uint8_t *in, uint32_t w, uint32_t h,
+        uint8_t *out)
+{
+    uint32_t x, y, k, i, r, g, b;
+    uint8_t *p = out;
+
+    for (y = 0; y < h / 2; y ++) {
+        for (x = 0; x < w / 2; x ++) {
+            r = g = b = 0;
+            for (k = 0; k < 4; k ++) {
+                i = ((y * 2 + k / 2) * w + x * 2 + k % 2) * 2;
+                r += R(in[i], in[i + 1]);
+                g += G(in[i], in[i + 1]);
+                b += B(in[i], in[i + 1]);
+            }
+            r = (r + 2) / 4;
+            g = (g + 2) / 4;
+            b = (b + 2) / 4;
+            *p++ = (r << 3) | (g >> 3);
+            *p++ = ((g & 7) << 5) | b;
+        }
+    }
+    return p - out;
+}
+
+static uint32_t ref_half_luma(const uint8_t *in, uint32_t w, uint32_t h,
+        uint8_t *out)
+{
+    uint32_t x, y;
+    uint8_t *p = out;
+
+    for (y = 0; y < h / 2; y ++) {
+        for (x = 0; x < w / 2; x ++) {
+            *p++ = (in[y * 2 * w + x * 2] + in[y * 2 * w + x * 2 + 1] +
+                in[(y * 2 + 1) * w + x * 2] +
+                in[(y * 2 + 1) * w + x * 2 + 1] + 2) / 4;
+        }
+    }
+    return p - out;
+}
+
+/* whole frame luma first, then the gradient at every inner pixel */
+static uint32_t ref_edges(const struct frame *f, uint8_t *out)
+{
+    static uint8_t luma[PIXELS];
+    uint32_t x, y, i, rowbytes = (W + 7) / 8;
+    int32_t gx, gy;
+
+    for (i = 0; i < PIXELS; i ++) {
+        luma[i] = Y(R(f->hi[i], f->lo[i]), G(f->hi[i], f->lo[i]),
+                B(f->hi[i], f->lo[i]));
+    }
+    memset(out, 0, rowbytes * H);
+    for (y = 1; y < H - 1; y ++) {
+        for (x = 1; x < W - 1; x ++) {
+            i = y * W + x;
+            gx = luma[i - W + 1] + 2 * luma[i + 1] + luma[i + W + 1] -
+                luma[i - W - 1] - 2 * luma[i - 1] - luma[i + W - 1];
+            gy = luma[i + W - 1] + 2 * luma[i + W] + luma[i + W + 1] -
+                luma[i - W - 1] - 2 * luma[i - W] - luma[i - W + 1];
+            if (abs(gx) + abs(gy) >= EDGE_THRESHOLD) {
+                out[y * rowbytes + x / 8] |= 0x80 >> (x % 8);
+            }
+        }
+    }
+    return rowbytes * H;
+}
+
+/* evenly spaced levels, rounded to the nearest */
+static uint32_t ref_rgb332(const struct frame *f, uint8_t *out)
+{
+    uint32_t i, r, g, b;
+
+    for (i = 0; i < PIXELS; i ++) {
+        r = (uint32_t) (R(f->hi[i], f->lo[i]) * 7 / 31.0 + 0.5);
+        g = (uint32_t) (G(f->hi[i], f->lo[i]) * 7 / 63.0 + 0.5);
+        b = (uint32_t) (B(f->hi[i], f->lo[i]) * 3 / 31.0 + 0.5);
+        out[i] = (r << 5) | (g << 2) | b;
+    }
+    return PIXELS;
+}
+
+/* --- firmware side, each fills out1 --- */
+
+static const struct frame *cur;
+
+static void run_stats(void)
+{
+    struct frame_stats st;
+
+    stats_compute(&st, cur->hi, cur->lo, PIXELS);
+    out1_len = stats_pack(&st, out1);
+}
+
+static void run_thumb(void)
+{
+    thumb_rgb565(cur->hi, cur->lo, W, H, out1);
+    out1_len = (W / 2) * (H / 2) * 2;
+}
+
+static void run_thumb_luma(void)
+{
+    thumb_rgb565_luma(cur->hi, cur->lo, W, H, out1);
+    out1_len = (W / 2) * (H / 2);
+}
+
+static void run_half_rgb565(void)
+{
+    thumb_half_rgb565(tmp, W / 2, H / 2, out1);
+    out1_len = (W / 4) * (H / 4) * 2;
+}
+
+static void run_half_luma(void)
+{
+    thumb_half_luma(tmp, W / 2, H / 2, out1);
+    out1_len = (W / 4) * (H / 4);
+}
+
+/* rows handed out by the streaming kernels go one after another */
+static void collect(const uint8_t *row, uint16_t bytes)
+{
+    memcpy(out1 + collect_len, row, bytes);
+    collect_len += bytes;
+}
+
+static void run_edges(void)
+{
+    collect_len = 0;
+    out1_len = edge_sobel(cur->hi, cur->lo, FMT_RGB565, W, H,
+            EDGE_THRESHOLD, collect);
+}
+
+static void run_rgb332(void)
+{
+    collect_len = 0;
+    quant_uniform();
+    quant_encode(cur->hi, cur->lo, FMT_RGB565, W, H, collect);
+    out1_len = collect_len;
+}
+
+static void run_palette(void)
+{
+    collect_len = 0;
+    quant_adapt(cur->hi, cur->lo, PIXELS);
+    quant_palette(collect);
+    quant_encode(cur->hi, cur->lo, FMT_RGB565, W, H, collect);
+    out1_len = collect_len;
+}
+
+static void run_blobs(void)
+{
+    struct blob_result res[BLOB_MAX_RESULTS];
+    uint32_t n;
+
+    n = blob_find(cur->hi, cur->lo, W, H, BLOB_MIN_AREA, res,
+            BLOB_MAX_RESULTS);
+    out1_len = blob_pack(res, n, out1);
+}
+
+static void run_swar_luma(void)
+{
+    swar_luma(cur->hi, cur->lo, PIXELS, out1);
+    out1_len = PIXELS;
+}
+
+static void run_swar_absdiff(void)
+{
+    swar_absdiff(cur->hi, cur->lo, PIXELS, out1);
+    out1_len = PIXELS;
+}
+
+static void run_swar_threshold(void)
+{
+    swar_threshold(cur->hi, PIXELS, 0x80, out1);
+    out1_len = PIXELS;
+}
+
+static void run_swar_addsat(void)
+{
+    swar_addsat(cur->hi, cur->lo, PIXELS, out1);
+    out1_len = PIXELS;
+}
+
+static void run_swar_avg(void)
+{
+    swar_avg(cur->hi, cur->lo, PIXELS, out1);
+    out1_len = PIXELS;
+}
+
+/* --- and their references into out2, 0 if there's none --- */
+
+static uint32_t check_stats(void) { return ref_stats(cur, out2); }
+static uint32_t check_thumb(void) { return ref_thumb(cur, out2); }
+static uint32_t check_thumb_luma(void) { return ref_thumb_luma(cur, out2); }
+static uint32_t check_edges(void) { return ref_edges(cur, out2); }
+static uint32_t check_rgb332(void) { return ref_rgb332(cur, out2); }
+
+static uint32_t check_half_rgb565(void)
+{
+    return ref_half_rgb565(tmp, W / 2, H / 2, out2);
+}
+
+static uint32_t check_half_luma(void)
+{
+    return ref_half_luma(tmp, W / 2, H / 2, out2);
+}
+
+static uint32_t check_swar_luma(void)
+{
+    swar_luma_ref(cur->hi, cur->lo, PIXELS, out2);
+    return PIXELS;
+}
+
+static uint32_t check_swar_absdiff(void)
+{
+    swar_absdiff_ref(cur->hi, cur->lo, PIXELS, out2);
+    return PIXELS;
+}
+
+static uint32_t check_swar_threshold(void)
+{
+    swar_threshold_ref(cur->hi, PIXELS, 0x80, out2);
+    return PIXELS;
+}
+
+static uint32_t check_swar_addsat(void)
+{
+    swar_addsat_ref(cur->hi, cur->lo, PIXELS, out2);
+    return PIXELS;
+}
+
+static uint32_t check_swar_avg(void)
+{
+    swar_avg_ref(cur->hi, cur->lo, PIXELS, out2);
+    return PIXELS;
+}
+
+/* the pyramid levels take the level above as input */
+static void prepare_rgb565(void)
+{
+    thumb_rgb565(cur->hi, cur->lo, W, H, tmp);
+}
+
+static void prepare_luma(void)
+{
+    thumb_rgb565_luma(cur->hi, cur->lo, W, H, tmp);
+}
+
+static const struct {
+    const char *name;
+    void (*prepare)(void);
+    void (*run)(void);
+    uint32_t (*check)(void);
+    uint32_t pixels;    /* input pixels, for the timing */
+} kernels[] = {
+    { "stats", NULL, run_stats, check_stats, PIXELS },
+    { "thumb_rgb565", NULL, run_thumb, check_thumb, PIXELS },
+    { "thumb_luma", NULL, run_thumb_luma, check_thumb_luma, PIXELS },
+    { "half_rgb565", prepare_rgb565, run_half_rgb565, check_half_rgb565,
+        PIXELS / 4 },
+    { "half_luma", prepare_luma, run_half_luma, check_half_luma,
+        PIXELS / 4 },
+    { "edges", NULL, run_edges, check_edges, PIXELS },
+    { "blobs", NULL, run_blobs, NULL, PIXELS },
+    { "rgb332", NULL, run_rgb332, check_rgb332, PIXELS },
+    { "palette", NULL, run_palette, NULL, PIXELS },
+    { "swar_luma", NULL, run_swar_luma, check_swar_luma, PIXELS },
+    { "swar_absdiff", NULL, run_swar_absdiff, check_swar_absdiff, PIXELS },
+    { "swar_threshold", NULL, run_swar_threshold, check_swar_threshold,
+        PIXELS },
+    { "swar_addsat", NULL, run_swar_addsat, check_swar_addsat, PIXELS },
+    { "swar_avg", NULL, run_swar_avg, check_swar_avg, PIXELS },
+};
+
+#define NUM_KERNELS (sizeof(kernels) / sizeof(kernels[0]))
+
+static const struct golden *find_golden(const char *kernel,
+        const char *frame)
+{
+    uint32_t i;
+
+    for (i = 0; i < NUM_GOLDENS; i ++) {
+        if (strcmp(goldens[i].kernel, kernel) == 0 &&
+                strcmp(goldens[i].frame, frame) == 0) {
+            return &goldens[i];
+        }
+    }
+    return NULL;
+}
+
+static void run_kernel(uint32_t k, const struct frame *f, int synthetic)
+{
+    const struct golden *g;
+    const char *result = "ok";
+    uint32_t i, d, len;
+    double start, ns;
+
+    cur = f;
+    if (kernels[k].prepare) {
+        kernels[k].prepare();
+    }
+    kernels[k].run();
+    d = digest(out1, out1_len);
+
+    if (kernels[k].check) {
+        len = kernels[k].check();
+        if (len != out1_len || memcmp(out1, out2, len) != 0) {
+            result = "DIFFERS";
+        }
+    }
+    g = synthetic ? find_golden(kernels[k].name, f->name) : NULL;
+    if (g && g->digest != d && strcmp(result, "ok") == 0) {
+        result = "GOLDEN";
+    }
+    if (strcmp(result, "ok") != 0) {
+        failed = 1;
+    }
+
+    start = now();
+    for (i = 0; i < iterations; i ++) {
+        kernels[k].run();
+    }
+    ns = (now() - start) * 1e9 / ((double) iterations * kernels[k].pixels);
+
+    if (print_goldens) {
+        if (synthetic) {
+            printf("    { \"%s\", \"%s\", 0x%08x },\n", kernels[k].name,
+                f->name, d);
+        }
+    } else {
+        printf("%-16s %-10s %08x %-8s %8.2f\n", kernels[k].name, f->name,
+            d, result, ns);
+    }
+}
+
+static void blob_classes(void)
+{
+    blob_set_class(0, 20, 31, 0, 20, 0, 10);  /* red */
+    blob_set_class(1, 0, 10, 0, 20, 20, 31);  /* blue */
+    blob_set_class(2, 0, 10, 48, 63, 0, 10);  /* green */
+}
+
+int main(int argc, char **argv)
+{
+    static struct frame f;
+    uint32_t i, k;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "gn:")) != -1) {
+        switch (opt) {
+        case 'g':
+            print_goldens = 1;
+            break;
+        case 'n':
+            iterations = atoi(optarg);
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-g] [-n iterations] "
+                "[frame.raw ...]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    blob_classes();
+    if (!print_goldens) {
+        printf("%-16s %-10s %-8s %-8s %8s\n", "kernel", "frame", "digest",
+            "result", "ns/px");
+    }
+    for (i = 0; i < NUM_PATTERNS; i ++) {
+        patterns[i].make(&f);
+        f.name = patterns[i].name;
+        for (k = 0; k < NUM_KERNELS; k ++) {
+            run_kernel(k, &f, 1);
+        }
+    }
+    for (i = optind; i < (uint32_t) argc; i ++) {
+        if (!load_frame(&f, argv[i])) {
+            failed = 1;
+            continue;
+        }
+        for (k = 0; k < NUM_KERNELS; k ++) {
+            run_kernel(k, &f, 0);
+        }
+    }
+    return failed;
+}
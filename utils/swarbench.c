@@ -0,0 +1,145 @@
+/*
+ * Host check & benchmark for the swar kernels (src/swar.c): every kernel
+ * is compared against its scalar reference over all input byte pairs, at
+ * odd lengths and offsets, and then both are timed on a qqvga frame.
+ *
+ *   gcc -O2 -I../src -o swarbench swarbench.c ../src/swar.c
+ *   ./swarbench [iterations]
+ *
+ * The timings are for the host and only show the ratio, exit status is
+ * non zero if any kernel doesn't match its reference.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "swar.h"
+
+#define PIXELS (160 * 120)
+#define PAIRS 0x10000
+
+static uint8_t a[PAIRS + 8], b[PAIRS + 8], out1[PAIRS + 8], out2[PAIRS + 8];
+
+typedef void (*kernel)(const uint8_t *, const uint8_t *, uint32_t,
+        uint8_t *);
+
+/* the ones that don't take two planes, with their extra argument fixed */
+static uint8_t arg;
+
+static void luma(const uint8_t *x, const uint8_t *y, uint32_t n,
+        uint8_t *out) { swar_luma(x, y, n, out); }
+static void luma_ref(const uint8_t *x, const uint8_t *y, uint32_t n,
+        uint8_t *out) { swar_luma_ref(x, y, n, out); }
+static void channel(const uint8_t *x, const uint8_t *y, uint32_t n,
+        uint8_t *out) { swar_channel(x, y, n, arg, out); }
+static void channel_ref(const uint8_t *x, const uint8_t *y, uint32_t n,
+        uint8_t *out) { swar_channel_ref(x, y, n, arg, out); }
+static void threshold(const uint8_t *x, const uint8_t *y, uint32_t n,
+        uint8_t *out) { (void) y; swar_threshold(x, n, arg, out); }
+static void threshold_ref(const uint8_t *x, const uint8_t *y, uint32_t n,
+        uint8_t *out) { (void) y; swar_threshold_ref(x, n, arg, out); }
+
+static const struct {
+    const char *name;
+    kernel swar, ref;
+    uint32_t args; /* values of arg to check */
+} kernels[] = {
+    { "luma", luma, luma_ref, 1 },
+    { "channel", channel, channel_ref, 3 },
+    { "absdiff", swar_absdiff, swar_absdiff_ref, 1 },
+    { "threshold", threshold, threshold_ref, 256 },
+    { "addsat", swar_addsat, swar_addsat_ref, 1 },
+    { "avg", swar_avg, swar_avg_ref, 1 },
+};
+
+#define NUM_KERNELS (sizeof(kernels) / sizeof(kernels[0]))
+
+static double now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* every (a, b) byte pair, at each start offset and a length that leaves
+ * a tail */
+static int check(uint32_t k)
+{
+    uint32_t i, off, n, v;
+
+    for (i = 0; i < PAIRS; i ++) {
+        a[i] = i >> 8;
+        b[i] = i;
+    }
+    for (v = 0; v < kernels[k].args; v ++) {
+        arg = v;
+        for (off = 0; off < 4; off ++) {
+            n = PAIRS - off - 1;
+            memset(out1, 0x55, sizeof(out1));
+            memset(out2, 0xaa, sizeof(out2));
+            kernels[k].swar(a + off, b + off, n, out1 + off);
+            kernels[k].ref(a + off, b + off, n, out2 + off);
+            for (i = off; i < off + n; i ++) {
+                if (out1[i] != out2[i]) {
+                    printf("%s: arg %d, a 0x%02x b 0x%02x: "
+                        "0x%02x, expected 0x%02x\n", kernels[k].name,
+                        arg, a[i], b[i], out1[i], out2[i]);
+                    return 0;
+                }
+            }
+        }
+    }
+    return 1;
+}
+
+/* random pixels for the timing */
+static void random_frame(void)
+{
+    uint32_t i;
+
+    srand(1);
+    for (i = 0; i < PIXELS; i ++) {
+        a[i] = rand();
+        b[i] = rand();
+    }
+}
+
+static double bench(kernel f, uint32_t iterations)
+{
+    double start = now();
+    uint32_t i;
+
+    for (i = 0; i < iterations; i ++) {
+        f(a, b, PIXELS, out1);
+        /* keep the calls from being folded together */
+        a[i % PIXELS] ^= out1[(i * 7) % PIXELS];
+    }
+    return (now() - start) * 1e9 / ((double) iterations * PIXELS);
+}
+
+int main(int argc, char **argv)
+{
+    uint32_t k, iterations = argc > 1 ? atoi(argv[1]) : 2000;
+    double t_ref, t_swar;
+    int failed = 0;
+
+    printf("%-10s %5s %10s %10s %7s\n", "kernel", "exact", "ref ns/px",
+        "swar ns/px", "speedup");
+    for (k = 0; k < NUM_KERNELS; k ++) {
+        if (!check(k)) {
+            failed = 1;
+            printf("%-10s %5s\n", kernels[k].name, "NO");
+            continue;
+        }
+        random_frame();
+        arg = kernels[k].args > 3 ? 64 : kernels[k].args - 1;
+        t_ref = bench(kernels[k].ref, iterations);
+        t_swar = bench(kernels[k].swar, iterations);
+        printf("%-10s %5s %10.3f %10.3f %6.2fx\n", kernels[k].name, "yes",
+            t_ref, t_swar, t_ref / t_swar);
+    }
+    return failed;
+}